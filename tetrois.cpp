@@ -3,19 +3,28 @@
 #include <vector>
 #include <string>
 #include <fstream>
+#include <cstdio>
 #include <cstdlib>
 #include <ctime>
 #include <algorithm>
+#include <memory>
 #include <ncurses.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
-// Configuration
-constexpr int GRID_ROWS = 20;
-constexpr int GRID_COLS = 10;
+#include "tetrois_engine.hpp"
+#include "tetrois_game.hpp"
+#include "tetrois_hint.hpp"
+#include "tetrois_input.hpp"
+#include "tetrois_planner.hpp"
+#include "tetrois_search.hpp"
 
 // Visual cell strings (3 chars wide, matching the old ANSI version)
 constexpr int CELL_W = 3;
 const std::string BLOCK = "[#]";
 const std::string GHOST = " # ";
+const std::string HINT = " + ";
 const std::string CLEAN = " . ";
 
 // Mini-displays for the "Next" box (plain strings; color applied by ncurses)
@@ -25,10 +34,14 @@ const std::vector<std::vector<std::string>> shapeDisplays = {
     {"   [#][#]", "[#][#] ", "", ""},
     {"[#][#]   ", "   [#][#]", "", ""},
     {"   [#]", "[#][#][#]", "", ""},
-    {"[#][#][#]", "[#]", "", ""},
-    {"[#][#][#]", "      [#]", "", ""},
+    {"      [#]", "[#][#][#]", "", ""},
+    {"[#]", "[#][#][#]", "", ""},
 };
 
+// Output still queued for the terminal beyond which a frame is skipped; a
+// frame is a few hundred bytes.
+constexpr int MAX_QUEUED_OUTPUT = 2048;
+
 // ncurses color pairs
 constexpr short PAIR_TITLE = 1;
 constexpr short PAIR_LABEL = 2;
@@ -37,170 +50,9 @@ constexpr short PAIR_LEVEL = 4;
 constexpr short PAIR_LINES = 5;
 constexpr short PAIR_HIGHSCORE = 6;
 constexpr short PAIR_GHOST = 7;
+constexpr short PAIR_HINT = 8;
 constexpr short PAIR_PIECE_BASE = 10; // 10..16
 
-struct Position
-{
-    int x;
-    int y;
-    Position(int x, int y) : x(x), y(y) {}
-
-    Position operator+(const Position &other) const { return Position(x + other.x, y + other.y); }
-    Position operator-(const Position &other) const { return Position(x - other.x, y - other.y); }
-};
-
-const Position VEC_DOWN(0, 1);
-const Position VEC_LEFT(-1, 0);
-const Position VEC_RIGHT(1, 0);
-
-struct Tetromino
-{
-    std::vector<Position> blocks;
-    short colorPair;
-    int shapeIdx;
-
-    Tetromino(short colorPair, const std::vector<Position> &blocks, int idx)
-        : blocks(blocks), colorPair(colorPair), shapeIdx(idx) {}
-
-    void move(const Position &direction)
-    {
-        for (auto &block : blocks)
-            block = block + direction;
-    }
-
-    void rotate()
-    {
-        if (shapeIdx == 0)
-            return; // O-piece doesn't rotate
-        Position center = blocks[0];
-        for (auto &block : blocks)
-        {
-            int rel_x = block.x - center.x;
-            int rel_y = block.y - center.y;
-            block.x = center.x - rel_y;
-            block.y = center.y + rel_x;
-        }
-    }
-};
-
-struct Block
-{
-    short colorPair;
-    bool occupied;
-    Block() : colorPair(0), occupied(false) {}
-};
-
-class Tetris
-{
-    int rows;
-    int cols;
-    std::vector<Block> grid;
-
-public:
-    Tetris(int rows, int cols) : rows(rows), cols(cols), grid(rows * cols) {}
-
-    int getRows() const { return rows; }
-    int getCols() const { return cols; }
-
-    bool isInside(const Position &p) const
-    {
-        return p.x >= 0 && p.x < cols && p.y >= 0 && p.y < rows;
-    }
-
-    bool isOccupied(const Position &p) const
-    {
-        if (!isInside(p))
-            return true;
-        return grid[p.y * cols + p.x].occupied;
-    }
-
-    const Block &at(const Position &p) const
-    {
-        return grid[p.y * cols + p.x];
-    }
-
-    bool checkCollision(const Tetromino &t) const
-    {
-        for (const auto &b : t.blocks)
-        {
-            if (isOccupied(b))
-                return true;
-        }
-        return false;
-    }
-
-    void lockTetromino(const Tetromino &t)
-    {
-        for (const auto &b : t.blocks)
-        {
-            if (!isInside(b))
-                continue;
-            Block &cell = grid[b.y * cols + b.x];
-            cell.occupied = true;
-            cell.colorPair = t.colorPair;
-        }
-    }
-
-    int clearLines()
-    {
-        std::vector<int> linesToClear;
-        for (int y = 0; y < rows; ++y)
-        {
-            bool full = true;
-            for (int x = 0; x < cols; ++x)
-            {
-                if (!grid[y * cols + x].occupied)
-                {
-                    full = false;
-                    break;
-                }
-            }
-            if (full)
-                linesToClear.push_back(y);
-        }
-
-        if (linesToClear.empty())
-            return 0;
-
-        std::vector<Block> newGrid(rows * cols);
-        int targetY = rows - 1;
-
-        for (int y = rows - 1; y >= 0; --y)
-        {
-            bool cleared = false;
-            for (int cy : linesToClear)
-            {
-                if (y == cy)
-                {
-                    cleared = true;
-                    break;
-                }
-            }
-            if (cleared)
-                continue;
-
-            for (int x = 0; x < cols; ++x)
-            {
-                newGrid[targetY * cols + x] = grid[y * cols + x];
-            }
-            --targetY;
-        }
-
-        grid = std::move(newGrid);
-        return (int)linesToClear.size();
-    }
-
-    Tetromino getGhost(Tetromino t) const
-    {
-        while (!checkCollision(t))
-        {
-            t.move(VEC_DOWN);
-        }
-        t.move(Position(0, -1));
-        return t;
-    }
-};
-
 static void initColors()
 {
     if (!has_colors())
@@ -215,6 +67,7 @@ static void initColors()
     init_pair(PAIR_LINES, COLOR_BLUE, -1);
     init_pair(PAIR_HIGHSCORE, COLOR_RED, -1);
     init_pair(PAIR_GHOST, COLOR_WHITE, -1);
+    init_pair(PAIR_HINT, COLOR_GREEN, -1);
 
     init_pair(PAIR_PIECE_BASE + 0, COLOR_YELLOW, -1);
     init_pair(PAIR_PIECE_BASE + 1, COLOR_CYAN, -1);
@@ -232,8 +85,14 @@ struct CursesSession
         initscr();
         cbreak();
         noecho();
-        keypad(stdscr, TRUE);
+        // Raw bytes: KeyDecoder reads the escape sequences itself, kitty
+        // key events included, which curses' keypad mode does not know.
+        keypad(stdscr, FALSE);
         nodelay(stdscr, TRUE);
+        // Lets curses shift rows with insert/delete line (or a scroll region)
+        // where whole lines moved, e.g. the stack after a line clear. Lines
+        // that share text with the side panel still redraw cell by cell.
+        idlok(stdscr, TRUE);
         curs_set(0);
         initColors();
     }
@@ -293,21 +152,40 @@ static void drawCellW(WINDOW *w, int y, int x, const std::string &s, short pair,
         wattroff(w, COLOR_PAIR(pair));
 }
 
-static void renderFrame(
-    const Tetris &game,
-    const Tetromino &current,
-    const Tetromino &next,
-    int score,
-    int level,
-    int highscore,
-    int lines)
+// Marks the cells a placement covers.
+static void markCells(const Placement &p, bool (&mask)[GRID_ROWS][GRID_COLS])
+{
+    const PieceRotation &r = PIECES[p.piece].rotations[p.rot];
+    for (int i = 0; i < 4; ++i)
+    {
+        const int x = p.x + r.cellX[i];
+        const int y = p.y + r.cellY[i];
+        if (x >= 0 && x < GRID_COLS && y >= 0 && y < GRID_ROWS)
+            mask[y][x] = true;
+    }
+}
+
+// Over a slow link (e.g. ssh) output backs up in the tty queue, and drawing
+// more into it only makes the screen lag further behind the game. Real
+// terminals report their queue (TIOCOUTQ); a pty reports none but stops
+// being writable once its buffer is full.
+static bool terminalBehind()
+{
+    int queued = 0;
+    if (ioctl(STDOUT_FILENO, TIOCOUTQ, &queued) == 0 && queued > MAX_QUEUED_OUTPUT)
+        return true;
+    pollfd out{STDOUT_FILENO, POLLOUT, 0};
+    return poll(&out, 1, 0) == 0;
+}
+
+static void renderFrame(const GameState &game, int highscore, const Placement *hint = nullptr)
 {
     int termRows = 0;
     int termCols = 0;
     getmaxyx(stdscr, termRows, termCols);
 
-    const int rows = game.getRows();
-    const int cols = game.getCols();
+    const int rows = GRID_ROWS;
+    const int cols = GRID_COLS;
     const int innerW = cols * CELL_W;
     const int gridW = innerW + 2;
     const int panelGap = 2;
@@ -333,19 +211,14 @@ static void renderFrame(
     const int originY = std::max(0, (termRows - viewH) / 2);
 
     // Precompute current and ghost masks for fast lookup
-    std::vector<std::vector<bool>> curMask(rows, std::vector<bool>(cols, false));
-    for (const auto &b : current.blocks)
-    {
-        if (game.isInside(b))
-            curMask[b.y][b.x] = true;
-    }
-    Tetromino ghost = game.getGhost(current);
-    std::vector<std::vector<bool>> ghostMask(rows, std::vector<bool>(cols, false));
-    for (const auto &b : ghost.blocks)
-    {
-        if (game.isInside(b))
-            ghostMask[b.y][b.x] = true;
-    }
+    bool curMask[GRID_ROWS][GRID_COLS] = {};
+    bool ghostMask[GRID_ROWS][GRID_COLS] = {};
+    bool hintMask[GRID_ROWS][GRID_COLS] = {};
+    markCells(game.current, curMask);
+    markCells(game.ghost(), ghostMask);
+    if (hint != nullptr)
+        markCells(*hint, hintMask);
+    const short currentPair = (short)(PAIR_PIECE_BASE + game.current.piece);
 
     erase();
 
@@ -383,7 +256,7 @@ static void renderFrame(
     {
         for (int x = 0; x < cols; ++x)
         {
-            Position p(x, y);
+            const uint8_t locked = game.cells[y][x];
             const int cellY = 1 + y;
             const int cellX = 1 + x * CELL_W;
 
@@ -392,15 +265,23 @@ static void renderFrame(
             int cellAttr = 0;
 
             // Placed blocks
-            if (game.at(p).occupied)
+            if (locked != 0)
             {
                 cellStr = BLOCK;
-                cellPair = game.at(p).colorPair;
+                cellPair = (short)(PAIR_PIECE_BASE + locked - 1);
                 cellAttr = A_BOLD;
             }
 
+            // Suggested placement on empty cells, under the ghost
+            if (locked == 0 && hintMask[y][x])
+            {
+                cellStr = HINT;
+                cellPair = PAIR_HINT;
+                cellAttr = A_DIM;
+            }
+
             // Ghost piece on empty cells
-            if (!game.at(p).occupied && ghostMask[y][x])
+            if (locked == 0 && ghostMask[y][x])
             {
                 cellStr = GHOST;
                 cellPair = PAIR_GHOST;
@@ -411,7 +292,7 @@ static void renderFrame(
             if (curMask[y][x])
             {
                 cellStr = BLOCK;
-                cellPair = current.colorPair;
+                cellPair = currentPair;
                 cellAttr = A_BOLD;
             }
 
@@ -430,15 +311,15 @@ static void renderFrame(
             if (y == 1)
                 drawTextW(panelWin, y + 1, 0, PAIR_LABEL, "SCORE", A_BOLD);
             if (y == 2)
-                drawTextW(panelWin, y + 1, 0, PAIR_SCORE, std::to_string(score), A_BOLD);
+                drawTextW(panelWin, y + 1, 0, PAIR_SCORE, std::to_string(game.score), A_BOLD);
             if (y == 4)
                 drawTextW(panelWin, y + 1, 0, PAIR_LABEL, "LEVEL", A_BOLD);
             if (y == 5)
-                drawTextW(panelWin, y + 1, 0, PAIR_LEVEL, std::to_string(level), A_BOLD);
+                drawTextW(panelWin, y + 1, 0, PAIR_LEVEL, std::to_string(game.level), A_BOLD);
             if (y == 7)
                 drawTextW(panelWin, y + 1, 0, PAIR_LABEL, "LINES", A_BOLD);
             if (y == 8)
-                drawTextW(panelWin, y + 1, 0, PAIR_LINES, std::to_string(lines), A_BOLD);
+                drawTextW(panelWin, y + 1, 0, PAIR_LINES, std::to_string(game.lines), A_BOLD);
             if (y == 10)
                 drawTextW(panelWin, y + 1, 0, PAIR_LABEL, "HIGHSCORE", A_BOLD);
             if (y == 11)
@@ -448,7 +329,7 @@ static void renderFrame(
             if (y >= 13 && y <= 16)
             {
                 int i = y - 13;
-                drawTextW(panelWin, y + 1, 0, next.colorPair, shapeDisplays[next.shapeIdx][i], A_BOLD);
+                drawTextW(panelWin, y + 1, 0, (short)(PAIR_PIECE_BASE + game.next), shapeDisplays[game.next][i], A_BOLD);
             }
 
             if (y == rows - 5)
@@ -456,7 +337,7 @@ static void renderFrame(
             if (y == rows - 4)
                 drawTextW(panelWin, y + 1, 0, 0, "A/D: Move");
             if (y == rows - 3)
-                drawTextW(panelWin, y + 1, 0, 0, "W: Rotate");
+                drawTextW(panelWin, y + 1, 0, 0, "W/E: Rotate");
             if (y == rows - 2)
                 drawTextW(panelWin, y + 1, 0, 0, "S: Down");
             if (y == rows - 1)
@@ -482,20 +363,20 @@ static void renderFrame(
 
         int r = 1;
         {
-            std::string s = "SCORE: " + std::to_string(score);
+            std::string s = "SCORE: " + std::to_string(game.score);
             if ((int)s.size() < contentW) s += std::string(contentW - (int)s.size(), ' ');
             drawTextW(stackedWin, r++, 1, PAIR_SCORE, s, A_BOLD);
         }
-        line(r++, "LEVEL: " + std::to_string(level));
-        line(r++, "LINES: " + std::to_string(lines));
+        line(r++, "LEVEL: " + std::to_string(game.level));
+        line(r++, "LINES: " + std::to_string(game.lines));
         line(r++, "HIGHSCORE: " + std::to_string(highscore));
         line(r++, "NEXT");
         for (int i = 0; i < 4; ++i)
-            line(r++, shapeDisplays[next.shapeIdx][i]);
+            line(r++, shapeDisplays[game.next][i]);
         line(r++, " ");
         line(r++, "CONTROLS");
         line(r++, "A/D: Move");
-        line(r++, "W: Rotate");
+        line(r++, "W/E: Rotate");
         line(r++, "S: Down");
         line(r++, "Space: Drop");
     }
@@ -514,165 +395,217 @@ static void renderFrame(
     delwin(gridWin);
 }
 
-bool gameLoop() {
-Tetris game(GRID_ROWS, GRID_COLS);
-    bool gameOver = false;
+struct GameOptions
+{
+    bool bot = false;  // let the heuristic bot place every piece
+    bool hint = false; // show the bot's move for the current piece ('h' toggles)
+    BotConfig botConfig; // timeBudgetMs caps the thinking time, 0 = until the piece first falls
+    AutoShiftConfig autoShift;
+    bool kitty = true; // ask the terminal for key release events
+};
 
-    int score = 0;
-    int level = 1;
-    int totalLines = 0;
-    int highscore = 0;
+// Writes straight to the terminal, past curses, for the kitty keyboard
+// escape codes.
+static void writeTerminal(const char *s)
+{
+    std::fputs(s, stdout);
+    std::fflush(stdout);
+}
 
-    std::ifstream highscoreFile("highscore.txt");
-    if (highscoreFile.is_open())
+// The kitty keyboard flags pushed for the game, popped again before the
+// game over screen or on the way out.
+struct KittyKeyboard
+{
+    bool pushed = false;
+
+    void push()
     {
-        highscoreFile >> highscore;
-        highscoreFile.close();
+        if (!pushed)
+            writeTerminal(KITTY_PUSH);
+        pushed = true;
     }
 
-    int lineScores[] = {0, 40, 100, 300, 1200};
+    void pop()
+    {
+        if (pushed)
+            writeTerminal(KITTY_POP);
+        pushed = false;
+    }
 
-    std::vector<std::vector<Position>> shapes = {
-        {Position(4, 0), Position(5, 0), Position(4, 1), Position(5, 1)},
-        {Position(3, 0), Position(4, 0), Position(5, 0), Position(6, 0)},
-        {Position(5, 0), Position(6, 0), Position(4, 1), Position(5, 1)},
-        {Position(4, 0), Position(5, 0), Position(5, 1), Position(6, 1)},
-        {Position(4, 0), Position(5, 0), Position(6, 0), Position(5, 1)},
-        {Position(4, 0), Position(5, 0), Position(6, 0), Position(4, 1)},
-        {Position(4, 0), Position(5, 0), Position(6, 0), Position(6, 1)},
-    };
+    ~KittyKeyboard() { pop(); }
+};
+
+bool gameLoop(const GameOptions &options) {
+    GameState game((uint64_t)std::time(nullptr));
+    bool quit = false;
 
-    std::srand((unsigned)std::time(nullptr));
+    int highscore = 0;
 
-    auto getNewTetromino = [&](int &idx)
+    std::ifstream highscoreFile("highscore.txt");
+    if (highscoreFile.is_open())
     {
-        idx = std::rand() % (int)shapes.size();
-        return Tetromino((short)(PAIR_PIECE_BASE + idx), shapes[idx], idx);
-    };
+        highscoreFile >> highscore;
+        highscoreFile.close();
+    }
 
-    int currentIdx = 0;
-    int nextIdx = 0;
-    Tetromino tetromino = getNewTetromino(currentIdx);
-    Tetromino nextT = getNewTetromino(nextIdx);
+    bool botPlaced = false;
+    std::unique_ptr<AsyncPlanner> planner;
+    if (options.bot)
+        planner.reset(new AsyncPlanner(options.botConfig));
+    std::chrono::steady_clock::time_point botDeadline;
+    uint32_t plannedPieces = 0;
+    std::unique_ptr<HintWorker> hints;
+    bool showHint = options.hint;
 
     int finalScore = 0;
     bool restartRequested = false;
+    int skippedFrames = 0;
     {
         CursesSession curses;
 
-        auto lastDrop = std::chrono::steady_clock::now();
-        int dropIntervalMs = 800;
+        TickClock clock;
+
+        // The bot thinks from the moment a piece spawns until gravity would
+        // first move it (at high gravity, for the lock delay), then its best
+        // move so far is played.
+        auto startPlanning = [&](std::chrono::steady_clock::time_point spawnTime)
+        {
+            plannedPieces = game.pieces;
+            botPlaced = false;
+            if (!planner)
+                return;
+            const uint8_t queue[2] = {(uint8_t)game.current.piece, (uint8_t)game.next};
+            planner->start(game.board, queue, 2, game.bag.remainingMask());
+            int thinkMs = std::max(game.nextEventTicks(), LOCK_DELAY_TICKS) * 1000 / TICK_HZ;
+            if (options.botConfig.timeBudgetMs > 0)
+                thinkMs = std::min(thinkMs, options.botConfig.timeBudgetMs);
+            botDeadline = spawnTime + std::chrono::milliseconds(thinkMs);
+        };
+
+        // Draws the hint only once it is ready for exactly this position.
+        Placement hintMove;
+        auto currentHint = [&]() -> const Placement *
+        {
+            if (!showHint)
+                return nullptr;
+            if (!hints)
+                hints.reset(new HintWorker(options.botConfig));
+            const uint8_t queue[2] = {(uint8_t)game.current.piece, (uint8_t)game.next};
+            hints->post(game.board, queue, 2, game.bag.remainingMask());
+            if (!hints->lookup(game.board, queue, 2, game.bag.remainingMask(), hintMove))
+                return nullptr;
+            return &hintMove;
+        };
 
         if (getenv("RENDER_ONCE"))
         {
-            renderFrame(game, tetromino, nextT, score, level, highscore, totalLines);
-            finalScore = score;
+            renderFrame(game, highscore);
+            finalScore = game.score;
             return 0;
         }
 
-        while (!gameOver)
+        KeyDecoder decoder;
+        KittyKeyboard kitty;
+        AutoShift autoShift(options.autoShift);
+        if (options.kitty)
+            writeTerminal(KITTY_QUERY);
+
+        // Left and right go through auto-shift, which repeats them on our
+        // clock, so the terminal's own repeats of them are ignored. Soft
+        // drop keeps the terminal's repeat; rotations and hard drop act on
+        // the press alone.
+        auto onKey = [&](const KeyEvent &e, std::chrono::steady_clock::time_point now)
         {
-            renderFrame(game, tetromino, nextT, score, level, highscore, totalLines);
-
-            int ch = getch();
-            if (ch != ERR)
+            const int dir = e.key == 'a' || e.key == ARROW_LEFT ? -1 : e.key == 'd' || e.key == ARROW_RIGHT ? 1 : 0;
+            if (dir != 0)
             {
-                Tetromino temp = tetromino;
+                if (e.action == KeyAction::Release)
+                    autoShift.release(dir, now);
+                else if (e.action == KeyAction::Press && autoShift.press(dir, now))
+                    game.apply(dir < 0 ? Input::Left : Input::Right);
+                return;
+            }
+            if (e.action == KeyAction::Release)
+                return;
+            if (e.key == 's' || e.key == ARROW_DOWN)
+                game.apply(Input::SoftDrop);
+            if (e.action == KeyAction::Repeat)
+                return;
+            if (e.key == 'q')
+                quit = true;
+            else if (e.key == 'h')
+                showHint = !showHint;
+            else if (e.key == 'w' || e.key == ARROW_UP)
+                game.apply(Input::RotateCW);
+            else if (e.key == 'e')
+                game.apply(Input::RotateCCW);
+            else if (e.key == ' ')
+                game.apply(Input::HardDrop);
+        };
 
-                if (ch == 'q')
-                {
-                    gameOver = true;
-                }
-                else if (ch == 'a' || ch == KEY_LEFT)
-                {
-                    temp.move(VEC_LEFT);
-                    if (!game.checkCollision(temp))
-                        tetromino = temp;
-                }
-                else if (ch == 'd' || ch == KEY_RIGHT)
-                {
-                    temp.move(VEC_RIGHT);
-                    if (!game.checkCollision(temp))
-                        tetromino = temp;
-                }
-                else if (ch == 's' || ch == KEY_DOWN)
-                {
-                    temp.move(VEC_DOWN);
-                    if (!game.checkCollision(temp))
-                        tetromino = temp;
-                }
-                else if (ch == 'w' || ch == KEY_UP)
-                {
-                    temp.rotate();
-                    if (!game.checkCollision(temp))
-                    {
-                        tetromino = temp;
-                    }
-                    else
-                    {
-                        Tetromino kicked = temp;
-                        kicked.move(VEC_RIGHT);
-                        if (!game.checkCollision(kicked))
-                        {
-                            tetromino = kicked;
-                        }
-                        else
-                        {
-                            kicked = temp;
-                            kicked.move(VEC_LEFT);
-                            kicked.move(VEC_LEFT);
-                            if (!game.checkCollision(kicked))
-                                tetromino = kicked;
-                        }
-                    }
-                }
-                else if (ch == ' ')
-                {
-                    while (!game.checkCollision(tetromino))
-                    {
-                        tetromino.move(VEC_DOWN);
-                    }
-                    tetromino.move(Position(0, -1));
-                    lastDrop = std::chrono::steady_clock::now() - std::chrono::seconds(10);
-                }
+        auto autoShiftDue = [&](std::chrono::steady_clock::time_point now)
+        {
+            int dir;
+            for (int n = autoShift.due(now, dir); n > 0; --n)
+            {
+                if (!game.apply(dir < 0 ? Input::Left : Input::Right))
+                    break;
             }
+        };
 
+        startPlanning(clock.start);
+        while (!quit && !game.over)
+        {
+            // Skipped frames are not queued: the next one drawn shows the
+            // latest state, so the screen is never more than a frame behind.
+            if (terminalBehind())
+                ++skippedFrames;
+            else
+                renderFrame(game, highscore, currentHint());
+
+            // Wait for a key only until the next tick or auto-shift is due.
+            // Drawing never stretches a tick; a slow frame just means more
+            // ticks run below.
             auto now = std::chrono::steady_clock::now();
-            if (std::chrono::duration_cast<std::chrono::milliseconds>(now - lastDrop).count() > dropIntervalMs)
+            const auto wake = std::min(clock.at(clock.ticks + 1), autoShift.nextDeadline(now));
+            const auto untilWake = std::chrono::duration_cast<std::chrono::microseconds>(wake - now);
+            timeout((int)std::max<int64_t>(0, (untilWake.count() + 999) / 1000));
+            // Everything the terminal has sent is decoded at once, so a burst
+            // of keys costs one frame, not one frame per key.
+            for (int ch = getch(); ch != ERR; ch = getch())
             {
-                Tetromino temp = tetromino;
-                temp.move(VEC_DOWN);
-
-                if (!game.checkCollision(temp))
-                {
-                    tetromino = temp;
-                }
-                else
-                {
-                    game.lockTetromino(tetromino);
-                    int cleared = game.clearLines();
-
-                    if (cleared > 0)
-                    {
-                        score += lineScores[cleared] * level;
-                        totalLines += cleared;
-                        level = (totalLines / 10) + 1;
-                        dropIntervalMs = std::max(100, 800 - (level * 50));
-                        if (score > highscore)
-                            highscore = score;
-                    }
-
-                    tetromino = nextT;
-                    nextT = getNewTetromino(nextIdx);
-
-                    if (game.checkCollision(tetromino))
-                        gameOver = true;
-                }
+                timeout(0);
+                KeyEvent e;
+                if (decoder.feed((uint8_t)ch, e))
+                    onKey(e, std::chrono::steady_clock::now());
+            }
+            if (decoder.kittySupported && !autoShift.releaseEvents)
+            {
+                kitty.push();
+                autoShift.releaseEvents = true;
+            }
 
-                lastDrop = now;
+            now = std::chrono::steady_clock::now();
+            autoShiftDue(now);
+            if (planner && !botPlaced && game.pieces == plannedPieces &&
+                (planner->finished() || std::chrono::steady_clock::now() >= botDeadline))
+            {
+                Placement move;
+                if (planner->best(move))
+                    game.place(move);
+                planner->cancel();
+                botPlaced = true;
             }
 
-            std::this_thread::sleep_for(std::chrono::milliseconds(90));
+            now = std::chrono::steady_clock::now();
+            // Shifts again after the ticks, so at ARR 0 a new piece goes
+            // straight to the wall while the key is held.
+            if (game.advance(clock.due(now)))
+                autoShiftDue(now);
+            highscore = std::max(highscore, game.score);
+
+            if (game.pieces != plannedPieces && !game.over)
+                startPlanning(now);
         }
 
         // Show a full-screen Game Over screen and wait for user input
@@ -745,10 +678,14 @@ Tetris game(GRID_ROWS, GRID_COLS);
             return (pressed == ' ');
         };
 
-        restartRequested = showGameOverScreen(score);
-        finalScore = score;
+        kitty.pop();
+        restartRequested = showGameOverScreen(game.score);
+        finalScore = game.score;
     } // endwin() here
 
+    if (skippedFrames > 0)
+        std::fprintf(stderr, "skipped %d frames while the terminal caught up\n", skippedFrames);
+
     if (finalScore >= highscore)
     {
         std::ofstream hf("highscore.txt");
@@ -759,12 +696,74 @@ Tetris game(GRID_ROWS, GRID_COLS);
     return restartRequested;
 }
 
-int main()
+int main(int argc, char **argv)
 {   
+    GameOptions options;
+    int threads = 1;
+    size_t hashMb = 16;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--bot")
+            options.bot = true;
+        else if (arg == "--hint")
+            options.hint = true;
+        else if (arg == "--beam" && i + 1 < argc)
+        {
+            options.bot = true;
+            options.botConfig.beamWidth = std::atoi(argv[++i]);
+        }
+        else if (arg == "--expectimax" && i + 1 < argc)
+        {
+            options.bot = true;
+            options.botConfig.expectimaxDepth = std::atoi(argv[++i]);
+        }
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = std::atoi(argv[++i]);
+        else if (arg == "--hash-mb" && i + 1 < argc)
+            hashMb = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--think-ms" && i + 1 < argc)
+            options.botConfig.timeBudgetMs = std::atoi(argv[++i]);
+        else if (arg == "--das" && i + 1 < argc)
+            options.autoShift.dasMs = std::atoi(argv[++i]);
+        else if (arg == "--arr" && i + 1 < argc)
+            options.autoShift.arrMs = std::atoi(argv[++i]);
+        else if (arg == "--release-ms" && i + 1 < argc)
+            options.autoShift.releaseMs = std::atoi(argv[++i]);
+        else if (arg == "--no-kitty")
+            options.kitty = false;
+        else if (arg == "--weights" && i + 1 < argc)
+        {
+            if (!loadWeights(argv[++i], options.botConfig.weights))
+            {
+                std::fprintf(stderr, "cannot read weights from %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--bot] [--hint] [--beam WIDTH] [--expectimax DEPTH] [--threads N] [--hash-mb MB] [--think-ms MS] [--weights FILE] [--das MS] [--arr MS] [--release-ms MS] [--no-kitty]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::unique_ptr<WorkStealingPool> pool;
+    std::unique_ptr<SharedTranspositionTable> table;
+    if (threads > 1)
+    {
+        pool.reset(new WorkStealingPool(threads));
+        options.botConfig.pool = pool.get();
+    }
+    if (hashMb > 0)
+    {
+        table.reset(new SharedTranspositionTable(hashMb));
+        options.botConfig.table = table.get();
+    }
+
     bool is_running{true};
     do
     {
-        is_running = gameLoop();
+        is_running = gameLoop(options);
     } while (is_running);
     return 0;
 }
\ No newline at end of file
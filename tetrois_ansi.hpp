@@ -0,0 +1,345 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "tetrois_engine.hpp"
+#include "tetrois_game.hpp"
+
+// Plain ANSI/VT100 backend for GameState, for terminals we only have a byte
+// stream to (tetrois-server renders into sockets). A frame is composed into
+// a cell buffer and diffed against the cells the terminal already shows, so
+// it costs escape codes only for the cells that changed: a piece falling one
+// row is a few dozen bytes, not a repaint. Line clears, which move the whole
+// stack down, are shifted by the terminal itself with a scroll region.
+
+class AnsiRenderer
+{
+public:
+    static constexpr int WIDTH = 52;
+    static constexpr int HEIGHT = GRID_ROWS + 3; // title, grid and its borders
+
+    // Appends the bytes that turn the previous frame into this one.
+    void render(const GameState &game, std::string &out)
+    {
+        compose(game);
+        const int cleared = game.lines - shownLines;
+        if (!fresh && cleared > 0 && cleared <= 4)
+            scrollCleared(cleared, out);
+        shownLines = game.lines;
+        emit(out);
+    }
+
+    // Appends a full repaint of what the last frame left on the screen, so
+    // another terminal can pick up this renderer's stream from here on
+    // (tetrois-server spectators).
+    void repaint(std::string &out) const
+    {
+        AnsiRenderer copy;
+        std::memcpy(copy.frame, shown, sizeof(shown));
+        copy.emit(out);
+    }
+
+    // The next render repaints the whole screen (e.g. after the client
+    // reconnects or its terminal was cleared).
+    void invalidate() { fresh = true; }
+
+    // Restores the cursor and attributes and moves below the frame; send
+    // before closing the connection.
+    static void finish(std::string &out)
+    {
+        out += "\x1b[0m\x1b[?25h\x1b[";
+        appendNumber(HEIGHT + 1, out);
+        out += ";1H\r\n";
+    }
+
+private:
+    void emit(std::string &out)
+    {
+        if (fresh)
+        {
+            // Start from a cleared screen so blank cells cost nothing.
+            out += "\x1b[?25l\x1b[0m\x1b[H\x1b[2J";
+            for (auto &row : shown)
+            {
+                for (Cell &c : row)
+                    c = Cell{' ', STYLE_PLAIN};
+            }
+            cursorY = cursorX = 0;
+            style = STYLE_PLAIN;
+            fresh = false;
+        }
+        else
+        {
+            // Make no assumptions about where the last frame left the cursor
+            // and colour, so every frame also works when replayed after a
+            // different renderer's (tetrois-server spectators start from a
+            // keyframe of their own). It costs one absolute move and one SGR.
+            cursorY = -1;
+            style = STYLE_NONE;
+        }
+
+        for (int y = 0; y < HEIGHT; ++y)
+        {
+            for (int x = 0; x < WIDTH; ++x)
+            {
+                const Cell c = frame[y][x];
+                if (c == shown[y][x])
+                    continue;
+                if (cursorY != y || cursorX != x)
+                    moveCursor(y, x, out);
+                if (c.style != style)
+                {
+                    out += "\x1b[";
+                    out += STYLE_SGR[c.style];
+                    out += 'm';
+                    style = c.style;
+                }
+                out += c.ch;
+                shown[y][x] = c;
+                ++cursorX;
+            }
+        }
+    }
+
+    enum Style : uint8_t
+    {
+        STYLE_PLAIN,
+        STYLE_TITLE,
+        STYLE_LABEL,
+        STYLE_SCORE,
+        STYLE_LEVEL,
+        STYLE_LINES,
+        STYLE_GHOST,
+        STYLE_ALERT,
+        STYLE_PIECE, // + piece index
+        STYLE_NONE = 0xff, // unknown, forces an SGR
+    };
+
+    // SGR parameters per style; piece colors match the ncurses game.
+    static constexpr const char *STYLE_SGR[STYLE_PIECE + PIECE_COUNT] = {
+        "0", "0;1;35", "0;1;33", "0;1;32", "0;1;36", "0;1;34", "0;2;37", "0;1;31",
+        "0;1;33", "0;1;36", "0;1;32", "0;1;31", "0;1;35", "0;1;34", "0;1;37",
+    };
+
+    struct Cell
+    {
+        char ch;
+        uint8_t style;
+
+        bool operator==(const Cell &o) const { return ch == o.ch && style == o.style; }
+    };
+
+    static constexpr int CELL_W = 3;
+    static constexpr int GRID_X = 0;
+    static constexpr int GRID_Y = 1;
+    static constexpr int PANEL_X = GRID_X + GRID_COLS * CELL_W + 4;
+    // Cells a scroll must save to pay for its escape codes.
+    static constexpr int SCROLL_COST = 24;
+
+    Cell frame[HEIGHT][WIDTH];
+    Cell shown[HEIGHT][WIDTH];
+    bool fresh = true;
+    int cursorY = 0;
+    int cursorX = 0;
+    uint8_t style = STYLE_PLAIN;
+    int shownLines = 0; // game.lines of the last frame
+
+    static void appendNumber(int value, std::string &out)
+    {
+        char digits[12];
+        int n = 0;
+        unsigned v = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+        do
+        {
+            digits[n++] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v != 0);
+        if (value < 0)
+            out += '-';
+        while (n > 0)
+            out += digits[--n];
+    }
+
+    void moveCursor(int y, int x, std::string &out)
+    {
+        out += "\x1b[";
+        if (y == cursorY && x > cursorX)
+        {
+            appendNumber(x - cursorX, out);
+            out += 'C';
+        }
+        else
+        {
+            appendNumber(y + 1, out);
+            out += ';';
+            appendNumber(x + 1, out);
+            out += 'H';
+        }
+        cursorY = y;
+        cursorX = x;
+    }
+
+    static int rowDiff(const Cell (&a)[WIDTH], const Cell (&b)[WIDTH])
+    {
+        int n = 0;
+        for (int x = 0; x < WIDTH; ++x)
+            n += a[x] == b[x] ? 0 : 1;
+        return n;
+    }
+
+    static int blankDiff(const Cell (&a)[WIDTH])
+    {
+        int n = 0;
+        for (int x = 0; x < WIDTH; ++x)
+            n += a[x] == Cell{' ', STYLE_PLAIN} ? 0 : 1;
+        return n;
+    }
+
+    // After `cleared` rows were cleared, the rows above them moved down. If
+    // shifting the terminal's rows down saves enough cells, the board rows
+    // from the top to the best band bottom are shifted with a scroll region
+    // (DECSTBM) and insert-line, and `shown` is shifted to match; the diff
+    // then redraws what the shift did not get right, such as the exposed top
+    // rows and the side panel, whose lines moved too.
+    void scrollCleared(int cleared, std::string &out)
+    {
+        const int top = GRID_Y + 1;
+        const int last = GRID_Y + GRID_ROWS;
+        int gain = 0;
+        int best = 0;
+        int bottom = -1;
+        for (int y = top; y <= last; ++y)
+        {
+            const int moved = y - cleared >= top ? rowDiff(frame[y], shown[y - cleared]) : blankDiff(frame[y]);
+            gain += rowDiff(frame[y], shown[y]) - moved;
+            if (gain > best)
+            {
+                best = gain;
+                bottom = y;
+            }
+        }
+        if (best <= SCROLL_COST)
+            return;
+
+        // Inserted lines take the current background, so reset it first.
+        // Setting and resetting the region both home the cursor.
+        out += "\x1b[0m\x1b[";
+        appendNumber(top + 1, out);
+        out += ';';
+        appendNumber(bottom + 1, out);
+        out += "r\x1b[";
+        appendNumber(top + 1, out);
+        out += "H\x1b[";
+        appendNumber(cleared, out);
+        out += "L\x1b[r";
+        for (int y = bottom; y >= top; --y)
+        {
+            for (int x = 0; x < WIDTH; ++x)
+                shown[y][x] = y - cleared >= top ? shown[y - cleared][x] : Cell{' ', STYLE_PLAIN};
+        }
+    }
+
+    void put(int y, int x, const char *text, uint8_t s)
+    {
+        for (; *text != '\0' && x < WIDTH; ++text, ++x)
+            frame[y][x] = Cell{*text, s};
+    }
+
+    void putNumber(int y, int x, int value, uint8_t s)
+    {
+        std::string digits;
+        appendNumber(value, digits);
+        put(y, x, digits.c_str(), s);
+    }
+
+    void compose(const GameState &game)
+    {
+        for (auto &row : frame)
+        {
+            for (Cell &c : row)
+                c = Cell{' ', STYLE_PLAIN};
+        }
+
+        put(0, GRID_X + (GRID_COLS * CELL_W + 2 - 13) / 2, "T E T R O I S", STYLE_TITLE);
+
+        // Grid box
+        const int right = GRID_X + GRID_COLS * CELL_W + 1;
+        const int bottom = GRID_Y + GRID_ROWS + 1;
+        for (int x = GRID_X; x <= right; ++x)
+        {
+            frame[GRID_Y][x] = Cell{'-', STYLE_PLAIN};
+            frame[bottom][x] = Cell{'-', STYLE_PLAIN};
+        }
+        for (int y = GRID_Y; y <= bottom; ++y)
+        {
+            const char edge = y == GRID_Y || y == bottom ? '+' : '|';
+            frame[y][GRID_X] = Cell{edge, STYLE_PLAIN};
+            frame[y][right] = Cell{edge, STYLE_PLAIN};
+        }
+
+        uint8_t overlay[GRID_ROWS][GRID_COLS] = {};
+        auto mark = [&](const Placement &p, uint8_t s)
+        {
+            const PieceRotation &r = PIECES[p.piece].rotations[p.rot];
+            for (int i = 0; i < 4; ++i)
+                overlay[p.y + r.cellY[i]][p.x + r.cellX[i]] = s;
+        };
+        if (!game.over)
+        {
+            mark(game.ghost(), STYLE_GHOST);
+            mark(game.current, (uint8_t)(STYLE_PIECE + game.current.piece));
+        }
+
+        for (int y = 0; y < GRID_ROWS; ++y)
+        {
+            for (int x = 0; x < GRID_COLS; ++x)
+            {
+                const int sy = GRID_Y + 1 + y;
+                const int sx = GRID_X + 1 + x * CELL_W;
+                const uint8_t locked = game.cells[y][x];
+                if (overlay[y][x] >= STYLE_PIECE)
+                    put(sy, sx, "[#]", overlay[y][x]);
+                else if (locked != 0)
+                    put(sy, sx, "[#]", (uint8_t)(STYLE_PIECE + locked - 1));
+                else if (overlay[y][x] == STYLE_GHOST)
+                    put(sy, sx, " # ", STYLE_GHOST);
+                else
+                    put(sy, sx, " . ", STYLE_PLAIN);
+            }
+        }
+
+        // Side panel
+        int y = GRID_Y + 2;
+        put(y++, PANEL_X, "SCORE", STYLE_LABEL);
+        putNumber(y++, PANEL_X, game.score, STYLE_SCORE);
+        ++y;
+        put(y++, PANEL_X, "LEVEL", STYLE_LABEL);
+        putNumber(y++, PANEL_X, game.level, STYLE_LEVEL);
+        ++y;
+        put(y++, PANEL_X, "LINES", STYLE_LABEL);
+        putNumber(y++, PANEL_X, game.lines, STYLE_LINES);
+        ++y;
+        put(y++, PANEL_X, "NEXT", STYLE_LABEL);
+        const PieceRotation &next = PIECES[game.next].rotations[0];
+        for (int i = 0; i < 4; ++i)
+            put(y + next.cellY[i] - next.minY, PANEL_X + (next.cellX[i] - next.minX) * CELL_W, "[#]",
+                (uint8_t)(STYLE_PIECE + game.next));
+
+        if (game.over)
+        {
+            const int midY = GRID_Y + GRID_ROWS / 2;
+            put(midY, GRID_X + 1, "          GAME  OVER          ", STYLE_ALERT);
+            put(midY + 1, GRID_X + 1, "        Space: Restart        ", STYLE_PLAIN);
+        }
+
+        y = GRID_Y + GRID_ROWS - 5;
+        put(y++, PANEL_X, "CONTROLS", STYLE_LABEL);
+        put(y++, PANEL_X, "A/D: Move", STYLE_PLAIN);
+        put(y++, PANEL_X, "W/E: Rotate", STYLE_PLAIN);
+        put(y++, PANEL_X, "S: Down", STYLE_PLAIN);
+        put(y++, PANEL_X, "Space: Drop", STYLE_PLAIN);
+        put(y++, PANEL_X, "Q: Quit", STYLE_PLAIN);
+    }
+};
@@ -0,0 +1,335 @@
+// Headless bot benchmark: plays seeded games with the heuristic bot (greedy,
+// beam search or expectimax) and reports evaluated nodes (placements scored)
+// per second along with how well it played.
+//
+//   g++ -std=c++17 -O2 -pthread tetrois_bench.cpp -o tetrois-bench
+//   ./tetrois-bench --games 20 --seed 1 --pieces 2000
+//   ./tetrois-bench --games 5 --beam 16 --preview 1 --think-ms 5
+//   ./tetrois-bench --games 5 --expectimax 1 --preview 1
+//   ./tetrois-bench --games 2 --pieces 200 --expectimax 2 --scaling
+//   ./tetrois-bench --beam 16 --preview 3 --count-allocs
+//   ./tetrois-bench --nn-export heuristic.tnn && ./tetrois-bench --nn heuristic.tnn --eval-speed
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "tetrois_search.hpp"
+
+// Counts heap allocations made by this process, for --count-allocs. The
+// replacements stay out of line so GCC does not pair malloc() with delete.
+static std::atomic<uint64_t> allocationCount{0};
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+// Plays one game and counts allocations made inside chooseMove(), after the
+// first decision has warmed up the thread's arena and tables. The search
+// path is expected not to allocate at all.
+static int countSearchAllocations(const BotConfig &config, uint64_t seed, int preview, int maxPieces)
+{
+    Board board;
+    Bag bag(seed);
+    uint8_t queue[16];
+    int queueLen = 0;
+    const int wanted = std::min(preview + 1, 16);
+    uint64_t allocations = 0;
+    int decisions = 0;
+
+    for (int piece = 0; piece < maxPieces; ++piece)
+    {
+        while (queueLen < wanted)
+            queue[queueLen++] = (uint8_t)bag.next();
+
+        const uint64_t before = allocationCount.load();
+        const SearchResult move = chooseMove(board, queue, queueLen, bag.remainingMask(), config);
+        if (piece > 0)
+        {
+            allocations += allocationCount.load() - before;
+            ++decisions;
+        }
+        if (!move.found)
+            break;
+        board.place(move.best);
+        board.clearLines();
+        std::copy(queue + 1, queue + queueLen, queue);
+        --queueLen;
+    }
+
+    std::printf("%llu allocations in %d searches after warm-up\n", (unsigned long long)allocations, decisions);
+    return allocations == 0 ? 0 : 1;
+}
+
+// Scores the candidate placements of positions from a seeded game with the
+// heuristic and with every available network kernel, and reports
+// evaluations per second. Fails if the kernels disagree.
+static int compareEvaluators(const BotConfig &config, const NnEvaluator &nn, uint64_t seed)
+{
+    constexpr int POSITIONS = 400;
+    constexpr int ROUNDS = 50;
+    std::vector<Board> boards;
+    std::vector<PlacementList> candidates;
+    Board board;
+    Bag bag(seed);
+    while ((int)boards.size() < POSITIONS)
+    {
+        PlacementList list;
+        const int piece = bag.next();
+        Placement best;
+        if (!generatePlacements(board, piece, list) || list.empty() ||
+            pickPlacement(board, piece, config.weights, best) == 0)
+        {
+            board = Board();
+            continue;
+        }
+        boards.push_back(board);
+        candidates.push_back(list);
+        board.place(best);
+        board.clearLines();
+    }
+
+    uint64_t perRound = 0;
+    for (const PlacementList &list : candidates)
+        perRound += list.size();
+    std::vector<double> scores(MAX_PLACEMENTS);
+    std::vector<double> reference(perRound);
+    double sink = 0;
+
+    auto time = [&](const char *name, auto &&scorePosition)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < ROUNDS; ++r)
+        {
+            for (int i = 0; i < POSITIONS; ++i)
+            {
+                scorePosition(i);
+                sink += scores[0];
+            }
+        }
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-10s %12.0f evals/s\n", name, secs > 0 ? perRound * ROUNDS / secs : 0.0);
+    };
+
+    time("heuristic", [&](int i) { evaluatePlacements(boards[i], candidates[i], config.weights, scores.data()); });
+
+    NnEvaluator net = nn;
+    bool first = true;
+    for (int k = NnEvaluator::KERNEL_SCALAR; k <= NnEvaluator::bestKernel(); ++k)
+    {
+        net.setKernel((NnEvaluator::Kernel)k);
+        time(NnEvaluator::kernelName(net.kernel()),
+             [&](int i) { net.evaluatePlacements(boards[i], candidates[i], scores.data()); });
+
+        size_t n = 0;
+        for (int i = 0; i < POSITIONS; ++i)
+        {
+            net.evaluatePlacements(boards[i], candidates[i], scores.data());
+            for (int c = 0; c < candidates[i].size(); ++c, ++n)
+            {
+                if (!first && scores[c] != reference[n])
+                {
+                    std::fprintf(stderr, "%s kernel disagrees with scalar\n", NnEvaluator::kernelName(net.kernel()));
+                    return 1;
+                }
+                reference[n] = scores[c];
+            }
+        }
+        first = false;
+    }
+    return sink == 12345.678 ? 1 : 0; // keeps the timed loops from being optimised away
+}
+
+static void usage()
+{
+    std::fprintf(stderr, "usage: tetrois-bench [--games N] [--seed S] [--pieces MAX] [--beam WIDTH] [--preview N] [--think-ms MS]\n"
+                 "                     [--expectimax DEPTH] [--expand K] [--min-prob P] [--threads T] [--scaling]\n"
+                 "                     [--hash-mb MB] [--weights FILE] [--count-allocs]\n"
+                 "                     [--nn FILE] [--nn-export FILE] [--eval-speed]\n"
+                 "  --threads and --scaling split the expectimax search over a work-stealing pool\n"
+                 "  --hash-mb sizes the expectimax transposition table (0 disables it, default 16)\n"
+                 "  --count-allocs fails unless the single-threaded search path is allocation free\n"
+                 "  --nn plays with a network evaluator, --nn-export writes the heuristic as a network file\n"
+                 "  --eval-speed compares heuristic and network evaluations per second\n");
+}
+
+struct BenchTotals
+{
+    uint64_t evaluated = 0;
+    long long pieces = 0;
+    long long lines = 0;
+    long long score = 0;
+    double secs = 0;
+};
+
+static BenchTotals runGames(const BotConfig &config, int games, uint64_t seed, int preview, int maxPieces)
+{
+    BenchTotals totals;
+    const auto start = std::chrono::steady_clock::now();
+    for (int g = 0; g < games; ++g)
+    {
+        const HeadlessResult r = playHeadlessGame(seed + g, config, preview, maxPieces);
+        totals.evaluated += r.evaluated;
+        totals.pieces += r.pieces;
+        totals.lines += r.lines;
+        totals.score += r.score;
+    }
+    totals.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return totals;
+}
+
+int main(int argc, char **argv)
+{
+    int games = 20;
+    uint64_t seed = 1;
+    int maxPieces = 2000;
+    int preview = 1;
+    int threads = 1;
+    bool scaling = false;
+    size_t hashMb = 16;
+    bool countAllocs = false;
+    bool evalSpeed = false;
+    const char *nnPath = nullptr;
+    const char *nnExport = nullptr;
+    BotConfig config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--games") && hasValue)
+            games = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--seed") && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--pieces") && hasValue)
+            maxPieces = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--beam") && hasValue)
+            config.beamWidth = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--preview") && hasValue)
+            preview = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--think-ms") && hasValue)
+            config.timeBudgetMs = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--expectimax") && hasValue)
+            config.expectimaxDepth = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--expand") && hasValue)
+            config.expandTop = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--min-prob") && hasValue)
+            config.minProbability = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--threads") && hasValue)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--hash-mb") && hasValue)
+            hashMb = std::strtoul(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--weights") && hasValue)
+        {
+            if (!loadWeights(argv[++i], config.weights))
+            {
+                std::fprintf(stderr, "cannot read weights from %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (!std::strcmp(arg, "--count-allocs"))
+            countAllocs = true;
+        else if (!std::strcmp(arg, "--nn") && hasValue)
+            nnPath = argv[++i];
+        else if (!std::strcmp(arg, "--nn-export") && hasValue)
+            nnExport = argv[++i];
+        else if (!std::strcmp(arg, "--eval-speed"))
+            evalSpeed = true;
+        else if (!std::strcmp(arg, "--scaling"))
+            scaling = true;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    NnEvaluator nn = NnEvaluator::fromHeuristic(config.weights);
+    if (nnExport != nullptr)
+    {
+        if (!nn.save(nnExport))
+        {
+            std::fprintf(stderr, "cannot write %s\n", nnExport);
+            return 1;
+        }
+        std::printf("wrote the heuristic as a network to %s\n", nnExport);
+        return 0;
+    }
+    if (nnPath != nullptr)
+    {
+        if (!nn.load(nnPath))
+        {
+            std::fprintf(stderr, "cannot read network from %s\n", nnPath);
+            return 1;
+        }
+        config.nn = &nn;
+    }
+    if (evalSpeed)
+        return compareEvaluators(config, nn, seed);
+
+    if (countAllocs)
+    {
+        SharedTranspositionTable table(hashMb);
+        if (hashMb > 0)
+            config.table = &table;
+        return countSearchAllocations(config, seed, preview, maxPieces);
+    }
+
+    std::vector<int> threadCounts = {threads < 1 ? 1 : threads};
+    if (scaling)
+        threadCounts = {1, 2, 4, 8, 16, 32};
+
+    double baseRate = 0;
+    for (int t : threadCounts)
+    {
+        WorkStealingPool pool(t);
+        SharedTranspositionTable table(hashMb);
+        if (t > 1 || scaling)
+            config.pool = &pool;
+        if (hashMb > 0)
+            config.table = &table;
+        const BenchTotals r = runGames(config, games, seed, preview, maxPieces);
+        const double rate = r.secs > 0 ? r.evaluated / r.secs : 0.0;
+        if (t == threadCounts.front())
+            baseRate = rate / t;
+
+        std::printf("threads %d: games %d, pieces %lld, lines %lld, avg score %.0f\n", t, games, r.pieces, r.lines,
+                    games > 0 ? (double)r.score / games : 0.0);
+        std::printf("  evaluated %llu nodes in %.3f s: %.0f nodes/s, %.0f pieces/s\n",
+                    (unsigned long long)r.evaluated, r.secs, rate, r.secs > 0 ? r.pieces / r.secs : 0.0);
+        const TableStats ts = table.stats();
+        if (config.table != nullptr && ts.hits + ts.misses + ts.stores > 0)
+        {
+            const uint64_t probes = ts.hits + ts.misses;
+            std::printf("  table %zu MB: %llu hits, %llu misses (%.1f%% hit rate), %llu stores, %llu collisions\n",
+                        table.bytes() >> 20, (unsigned long long)ts.hits, (unsigned long long)ts.misses,
+                        probes > 0 ? 100.0 * ts.hits / probes : 0.0, (unsigned long long)ts.stores,
+                        (unsigned long long)ts.collisions);
+        }
+        if (scaling)
+            std::printf("  speedup %.2fx, efficiency %.0f%%\n", baseRate > 0 ? rate / baseRate : 0.0,
+                        baseRate > 0 ? 100.0 * rate / (baseRate * t) : 0.0);
+        config.pool = nullptr;
+        config.table = nullptr;
+    }
+    return 0;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "tetrois_engine.hpp"
+
+// Heuristic bot: scores a board from a handful of features computed on the
+// row masks (popcounts and shifts, no per-cell loops) and picks the best of
+// all placements from generatePlacements().
+
+struct BoardFeatures
+{
+    int aggregateHeight;
+    int holes;
+    int bumpiness;
+    int wells;
+    int rowTransitions;
+    int colTransitions;
+    int linesCleared;
+    int heights[GRID_COLS]; // per column, not weighted by EvalWeights
+};
+
+struct EvalWeights
+{
+    double aggregateHeight;
+    double holes;
+    double bumpiness;
+    double wells;
+    double rowTransitions;
+    double colTransitions;
+    double linesCleared;
+};
+
+constexpr EvalWeights DEFAULT_WEIGHTS = {-0.51, -3.6, -0.18, -0.45, -0.32, -0.93, 0.76};
+
+// Weight files hold one "name value" line per field, in any order; lines
+// starting with '#' are comments. Fields left out keep their current value.
+constexpr int WEIGHT_COUNT = 7;
+constexpr const char *WEIGHT_NAMES[WEIGHT_COUNT] = {
+    "aggregateHeight", "holes", "bumpiness", "wells", "rowTransitions", "colTransitions", "linesCleared"};
+constexpr double EvalWeights::*WEIGHT_FIELDS[WEIGHT_COUNT] = {
+    &EvalWeights::aggregateHeight, &EvalWeights::holes,          &EvalWeights::bumpiness,
+    &EvalWeights::wells,           &EvalWeights::rowTransitions, &EvalWeights::colTransitions,
+    &EvalWeights::linesCleared};
+
+inline bool saveWeights(const char *path, const EvalWeights &w)
+{
+    FILE *f = std::fopen(path, "w");
+    if (f == nullptr)
+        return false;
+    for (int i = 0; i < WEIGHT_COUNT; ++i)
+        std::fprintf(f, "%s %.17g\n", WEIGHT_NAMES[i], w.*WEIGHT_FIELDS[i]);
+    return std::fclose(f) == 0;
+}
+
+// Returns false if the file cannot be read or names an unknown field.
+inline bool loadWeights(const char *path, EvalWeights &w)
+{
+    FILE *f = std::fopen(path, "r");
+    if (f == nullptr)
+        return false;
+    char line[256];
+    bool ok = true;
+    while (ok && std::fgets(line, sizeof(line), f))
+    {
+        char name[64];
+        double value;
+        if (line[0] == '#' || std::sscanf(line, "%63s", name) != 1)
+            continue;
+        ok = std::sscanf(line, "%63s %lf", name, &value) == 2;
+        int field = 0;
+        while (ok && field < WEIGHT_COUNT && std::strcmp(name, WEIGHT_NAMES[field]) != 0)
+            ++field;
+        ok = ok && field < WEIGHT_COUNT;
+        if (ok)
+            w.*WEIGHT_FIELDS[field] = value;
+    }
+    std::fclose(f);
+    return ok;
+}
+
+inline int popcount(uint32_t v)
+{
+    return __builtin_popcount(v);
+}
+
+inline BoardFeatures computeFeatures(const Board &board, int linesCleared)
+{
+    constexpr uint32_t WALLS = 1u | (1u << (GRID_COLS + 1));
+    constexpr uint32_t EDGES = (1u << (GRID_COLS + 1)) - 1;
+
+    BoardFeatures f{};
+    f.linesCleared = linesCleared;
+
+    int *heights = f.heights;
+    uint32_t above = 0; // columns with a filled cell somewhere above this row
+    int y = 0;
+    while (y < GRID_ROWS && board.rows[y] == 0)
+        ++y;
+    if (y < GRID_ROWS)
+        f.colTransitions = popcount(board.rows[y]);
+
+    for (; y < GRID_ROWS; ++y)
+    {
+        const uint32_t row = board.rows[y];
+        const uint32_t empty = ~row & FULL_ROW;
+
+        for (uint32_t fresh = row & ~above; fresh != 0; fresh &= fresh - 1)
+            heights[__builtin_ctz(fresh)] = GRID_ROWS - y;
+
+        f.holes += popcount(empty & above);
+
+        const uint32_t walled = (row << 1) | WALLS;
+        f.rowTransitions += popcount((walled ^ (walled >> 1)) & EDGES);
+
+        const uint32_t wellSides = ((row << 1) | 1u) & ((row >> 1) | (1u << (GRID_COLS - 1)));
+        f.wells += popcount(empty & wellSides & ~above);
+
+        if (y + 1 < GRID_ROWS)
+            f.colTransitions += popcount(row ^ board.rows[y + 1]);
+        else
+            f.colTransitions += popcount(empty);
+
+        above |= row;
+    }
+
+    for (int x = 0; x < GRID_COLS; ++x)
+    {
+        f.aggregateHeight += heights[x];
+        if (x + 1 < GRID_COLS)
+            f.bumpiness += heights[x] > heights[x + 1] ? heights[x] - heights[x + 1] : heights[x + 1] - heights[x];
+    }
+    return f;
+}
+
+inline double evaluate(const BoardFeatures &f, const EvalWeights &w)
+{
+    return w.aggregateHeight * f.aggregateHeight + w.holes * f.holes + w.bumpiness * f.bumpiness +
+           w.wells * f.wells + w.rowTransitions * f.rowTransitions + w.colTransitions * f.colTransitions +
+           w.linesCleared * f.linesCleared;
+}
+
+// Scores every candidate placement of one piece in a single pass.
+inline void evaluatePlacements(const Board &board, const PlacementList &candidates, const EvalWeights &weights,
+                               double *scores)
+{
+    for (int i = 0; i < candidates.size(); ++i)
+    {
+        Board next = board;
+        next.place(candidates[i]);
+        const int cleared = next.clearLines();
+        scores[i] = evaluate(computeFeatures(next, cleared), weights);
+    }
+}
+
+// Picks the best placement for piece. Returns the number of candidates
+// evaluated, 0 when the piece cannot spawn.
+inline int pickPlacement(const Board &board, int piece, const EvalWeights &weights, Placement &best)
+{
+    PlacementList candidates;
+    double scores[MAX_PLACEMENTS];
+    if (!generatePlacements(board, piece, candidates) || candidates.empty())
+        return 0;
+    evaluatePlacements(board, candidates, weights, scores);
+
+    int bestIdx = 0;
+    for (int i = 1; i < candidates.size(); ++i)
+    {
+        if (scores[i] > scores[bestIdx])
+            bestIdx = i;
+    }
+    best = candidates[bestIdx];
+    return candidates.size();
+}
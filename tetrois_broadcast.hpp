@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+// Spectator fan-out: a game's encoded frames go into one FrameRing, and
+// every viewer sends straight out of the shared, reference-counted frame
+// buffers, so a frame is rendered and stored once however many people
+// watch. The frames are AnsiRenderer diffs, so a viewer must start from a
+// keyframe (a full repaint of the current state) and then take every later
+// frame in order; a viewer that falls too far behind drops the frames it
+// has not started sending and takes a fresh keyframe instead.
+
+struct EncodedFrame
+{
+    std::string bytes;
+};
+
+using FrameRef = std::shared_ptr<const EncodedFrame>;
+
+inline FrameRef makeFrame(std::string bytes)
+{
+    auto frame = std::make_shared<EncodedFrame>();
+    frame->bytes = std::move(bytes);
+    return frame;
+}
+
+// The last `capacity` frames of one game, numbered from 0. Frames stay
+// alive while any viewer still holds them, even after the ring moved on.
+class FrameRing
+{
+public:
+    explicit FrameRing(size_t capacity) : frames(capacity) {}
+
+    // Sequence number the next published frame will get.
+    uint64_t head() const { return next; }
+    size_t capacity() const { return frames.size(); }
+
+    void publish(FrameRef frame)
+    {
+        frames[next % frames.size()] = std::move(frame);
+        ++next;
+        keyframe.reset(); // describes an older state now
+    }
+
+    // nullptr once seq has been overwritten.
+    const FrameRef &at(uint64_t seq) const
+    {
+        static const FrameRef none;
+        return seq < next && next - seq <= frames.size() ? frames[seq % frames.size()] : none;
+    }
+
+    // A keyframe of the state at head(), made by make() at most once per
+    // head however many viewers join or skip at that point.
+    template <typename Fn>
+    const FrameRef &keyframeAtHead(const Fn &make)
+    {
+        if (!keyframe)
+            keyframe = make();
+        return keyframe;
+    }
+
+private:
+    std::vector<FrameRef> frames;
+    uint64_t next = 0;
+    FrameRef keyframe;
+};
+
+// One viewer's position in a FrameRing and the frames queued for its
+// socket, sent with scatter-gather I/O straight from the shared buffers.
+class FrameCursor
+{
+public:
+    // Starts (or restarts) the viewer at the ring's head with a keyframe.
+    template <typename Fn>
+    void join(FrameRing &ring, const Fn &makeKeyframe)
+    {
+        dropUnsent();
+        pending.push_back(ring.keyframeAtHead(makeKeyframe));
+        next = ring.head();
+    }
+
+    // Queues a frame outside the game stream (e.g. telnet negotiation).
+    void push(FrameRef frame) { pending.push_back(std::move(frame)); }
+
+    // Queues every frame published since the last call. If more than
+    // maxBacklog frames would be waiting, or some were already overwritten,
+    // the unsent ones are dropped for a keyframe instead. Returns how many
+    // frames were skipped.
+    template <typename Fn>
+    uint64_t catchUp(FrameRing &ring, size_t maxBacklog, const Fn &makeKeyframe)
+    {
+        const uint64_t head = ring.head();
+        const bool lost = head - next > ring.capacity();
+        if (lost || pending.size() + (head - next) > maxBacklog)
+        {
+            const uint64_t skipped = (head - next) + pending.size() - (offset > 0 ? 1 : 0);
+            join(ring, makeKeyframe);
+            return skipped;
+        }
+        for (; next < head; ++next)
+            pending.push_back(ring.at(next));
+        return 0;
+    }
+
+    bool empty() const { return pending.empty(); }
+
+    // Fills up to max iovecs with the unsent bytes, oldest first.
+    int gather(iovec *iov, int max) const
+    {
+        int n = 0;
+        for (size_t i = 0; i < pending.size() && n < max; ++i)
+        {
+            const std::string &b = pending[i]->bytes;
+            const size_t skip = i == 0 ? offset : 0;
+            if (b.size() == skip)
+                continue;
+            iov[n].iov_base = (void *)(b.data() + skip);
+            iov[n].iov_len = b.size() - skip;
+            ++n;
+        }
+        return n;
+    }
+
+    // Records that the first `bytes` unsent bytes went out.
+    void consumed(size_t bytes)
+    {
+        while (!pending.empty())
+        {
+            const size_t left = pending.front()->bytes.size() - offset;
+            if (bytes < left)
+            {
+                offset += bytes;
+                return;
+            }
+            bytes -= left;
+            pending.pop_front();
+            offset = 0;
+        }
+    }
+
+private:
+    std::deque<FrameRef> pending;
+    size_t offset = 0; // bytes of pending.front() already sent
+    uint64_t next = 0; // next sequence number to queue
+
+    // Drops queued frames, except one already partly sent: cutting it off
+    // mid escape sequence would garble the terminal.
+    void dropUnsent()
+    {
+        const size_t keep = offset > 0 ? 1 : 0;
+        while (pending.size() > keep)
+            pending.pop_back();
+    }
+};
@@ -0,0 +1,439 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Placement engine shared by the game and the command line tools.
+// The board is kept as one bit mask per row (bit x = column x, row 0 = top),
+// which makes collision tests a handful of ANDs instead of per-cell lookups.
+
+// Configuration
+constexpr int GRID_ROWS = 20;
+constexpr int GRID_COLS = 10;
+
+constexpr int PIECE_COUNT = 7;
+const char PIECE_NAMES[PIECE_COUNT + 1] = "OISZTLJ";
+
+// Points per clear of 0..4 lines, multiplied by the level.
+constexpr int LINE_SCORES[5] = {0, 40, 100, 300, 1200};
+
+// Garbage rows sent to an opponent for clearing 0..4 lines at once.
+constexpr int GARBAGE_LINES[5] = {0, 0, 1, 2, 4};
+
+using RowMask = uint16_t;
+constexpr uint32_t ALL_PIECES = (1u << PIECE_COUNT) - 1;
+constexpr RowMask FULL_ROW = (RowMask)((1u << GRID_COLS) - 1);
+
+// One orientation of a piece: cell offsets relative to the piece origin plus
+// the same cells folded into row masks (relative to minX / minY).
+struct PieceRotation
+{
+    int8_t cellX[4];
+    int8_t cellY[4];
+    int8_t minX;
+    int8_t maxX;
+    int8_t minY;
+    int8_t height;
+    RowMask rows[4];
+};
+
+struct PieceDef
+{
+    PieceRotation rotations[4];
+    int8_t spawnX;
+    int8_t spawnY;
+};
+
+// SRS spawn orientations, as cells inside each piece's bounding box
+// (origin = top-left of the box). Rotations turn the box about its center.
+constexpr int8_t SRS_CELLS[PIECE_COUNT][4][2] = {
+    {{1, 0}, {2, 0}, {1, 1}, {2, 1}},
+    {{0, 1}, {1, 1}, {2, 1}, {3, 1}},
+    {{1, 0}, {2, 0}, {0, 1}, {1, 1}},
+    {{0, 0}, {1, 0}, {1, 1}, {2, 1}},
+    {{1, 0}, {0, 1}, {1, 1}, {2, 1}},
+    {{2, 0}, {0, 1}, {1, 1}, {2, 1}},
+    {{0, 0}, {0, 1}, {1, 1}, {2, 1}},
+};
+constexpr int8_t SRS_BOX[PIECE_COUNT] = {3, 4, 3, 3, 3, 3, 3};
+constexpr int8_t SPAWN_X = 3;
+constexpr int8_t SPAWN_Y[PIECE_COUNT] = {0, -1, 0, 0, 0, 0, 0};
+
+// Wall kick offsets (x, y with y pointing down) tried in order for each
+// rotation, indexed by [from rotation][direction: 0 = clockwise, 1 = counter-clockwise].
+constexpr int KICK_COUNT = 5;
+constexpr int ROTATE_CW = 0;
+constexpr int ROTATE_CCW = 1;
+
+constexpr int8_t KICKS_JLSTZ[4][2][KICK_COUNT][2] = {
+    {{{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}, {{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}},
+    {{{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}, {{0, 0}, {1, 0}, {1, 1}, {0, -2}, {1, -2}}},
+    {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}}, {{0, 0}, {-1, 0}, {-1, -1}, {0, 2}, {-1, 2}}},
+    {{{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}, {{0, 0}, {-1, 0}, {-1, 1}, {0, -2}, {-1, -2}}},
+};
+
+constexpr int8_t KICKS_I[4][2][KICK_COUNT][2] = {
+    {{{0, 0}, {-2, 0}, {1, 0}, {-2, 1}, {1, -2}}, {{0, 0}, {-1, 0}, {2, 0}, {-1, -2}, {2, 1}}},
+    {{{0, 0}, {-1, 0}, {2, 0}, {-1, -2}, {2, 1}}, {{0, 0}, {2, 0}, {-1, 0}, {2, -1}, {-1, 2}}},
+    {{{0, 0}, {2, 0}, {-1, 0}, {2, -1}, {-1, 2}}, {{0, 0}, {1, 0}, {-2, 0}, {1, 2}, {-2, -1}}},
+    {{{0, 0}, {1, 0}, {-2, 0}, {1, 2}, {-2, -1}}, {{0, 0}, {-2, 0}, {1, 0}, {-2, 1}, {1, -2}}},
+};
+
+constexpr PieceRotation makeRotation(const int8_t (&xs)[4], const int8_t (&ys)[4])
+{
+    PieceRotation r{};
+    r.minX = r.maxX = xs[0];
+    r.minY = ys[0];
+    int8_t maxY = ys[0];
+    for (int i = 0; i < 4; ++i)
+    {
+        r.cellX[i] = xs[i];
+        r.cellY[i] = ys[i];
+        r.minX = xs[i] < r.minX ? xs[i] : r.minX;
+        r.maxX = xs[i] > r.maxX ? xs[i] : r.maxX;
+        r.minY = ys[i] < r.minY ? ys[i] : r.minY;
+        maxY = ys[i] > maxY ? ys[i] : maxY;
+    }
+    r.height = (int8_t)(maxY - r.minY + 1);
+    for (int i = 0; i < 4; ++i)
+        r.rows[ys[i] - r.minY] |= (RowMask)(1u << (xs[i] - r.minX));
+    return r;
+}
+
+constexpr std::array<PieceDef, PIECE_COUNT> buildPieceTable()
+{
+    std::array<PieceDef, PIECE_COUNT> table{};
+    for (int p = 0; p < PIECE_COUNT; ++p)
+    {
+        int8_t xs[4] = {};
+        int8_t ys[4] = {};
+        for (int i = 0; i < 4; ++i)
+        {
+            xs[i] = SRS_CELLS[p][i][0];
+            ys[i] = SRS_CELLS[p][i][1];
+        }
+        for (int r = 0; r < 4; ++r)
+        {
+            table[p].rotations[r] = makeRotation(xs, ys);
+            if (p == 0)
+                continue; // O-piece doesn't rotate
+            for (int i = 0; i < 4; ++i)
+            {
+                const int8_t oldX = xs[i];
+                xs[i] = (int8_t)(SRS_BOX[p] - 1 - ys[i]);
+                ys[i] = oldX;
+            }
+        }
+        table[p].spawnX = SPAWN_X;
+        table[p].spawnY = SPAWN_Y[p];
+    }
+    return table;
+}
+
+constexpr std::array<PieceDef, PIECE_COUNT> PIECES = buildPieceTable();
+
+inline int pieceFromName(char c)
+{
+    for (int p = 0; p < PIECE_COUNT; ++p)
+    {
+        if (PIECE_NAMES[p] == c || PIECE_NAMES[p] == c - 'a' + 'A')
+            return p;
+    }
+    return -1;
+}
+
+// A resting position of a piece: origin (x, y) and rotation index.
+struct Placement
+{
+    int8_t piece;
+    int8_t rot;
+    int8_t x;
+    int8_t y;
+};
+
+// Every placement of one rotation has its own (x, y), so a piece can never
+// rest in more than 4 * cols * rows distinct ways.
+constexpr int MAX_PLACEMENTS = 4 * GRID_COLS * GRID_ROWS;
+
+// Fixed-capacity placement list: lives on the stack or in an arena, so
+// generating moves never touches the heap.
+struct PlacementList
+{
+    int count = 0;
+    Placement items[MAX_PLACEMENTS];
+
+    void clear() { count = 0; }
+    void push_back(const Placement &p) { items[count++] = p; }
+    int size() const { return count; }
+    bool empty() const { return count == 0; }
+    const Placement &operator[](int i) const { return items[i]; }
+    const Placement *begin() const { return items; }
+    const Placement *end() const { return items + count; }
+};
+
+struct Board
+{
+    std::array<RowMask, GRID_ROWS> rows{};
+
+    bool collides(int piece, int rot, int x, int y) const
+    {
+        const PieceRotation &r = PIECES[piece].rotations[rot];
+        const int left = x + r.minX;
+        const int top = y + r.minY;
+        if (left < 0 || x + r.maxX >= GRID_COLS || top < 0 || top + r.height > GRID_ROWS)
+            return true;
+        for (int i = 0; i < r.height; ++i)
+        {
+            if (rows[top + i] & (RowMask)(r.rows[i] << left))
+                return true;
+        }
+        return false;
+    }
+
+    // Rotates a piece at (x, y) using the SRS kick table. On success rot, x
+    // and y are updated to the first kick position that fits.
+    bool tryRotate(int piece, int dir, int &rot, int &x, int &y) const
+    {
+        if (piece == 0)
+            return true; // O-piece doesn't rotate
+        const int to = dir == ROTATE_CW ? (rot + 1) & 3 : (rot + 3) & 3;
+        const auto &kicks = piece == 1 ? KICKS_I[rot][dir] : KICKS_JLSTZ[rot][dir];
+        for (int k = 0; k < KICK_COUNT; ++k)
+        {
+            const int kx = x + kicks[k][0];
+            const int ky = y + kicks[k][1];
+            if (!collides(piece, to, kx, ky))
+            {
+                rot = to;
+                x = kx;
+                y = ky;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void place(const Placement &p)
+    {
+        const PieceRotation &r = PIECES[p.piece].rotations[p.rot];
+        const int left = p.x + r.minX;
+        const int top = p.y + r.minY;
+        for (int i = 0; i < r.height; ++i)
+            rows[top + i] |= (RowMask)(r.rows[i] << left);
+    }
+
+    int clearLines()
+    {
+        int target = GRID_ROWS - 1;
+        for (int y = GRID_ROWS - 1; y >= 0; --y)
+        {
+            if (rows[y] == FULL_ROW)
+                continue;
+            rows[target--] = rows[y];
+        }
+        const int cleared = target + 1;
+        for (int y = 0; y < cleared; ++y)
+            rows[y] = 0;
+        return cleared;
+    }
+
+    // Pushes the stack up by count rows and fills the bottom with garbage
+    // rows, solid but for a hole at holeColumn. Returns false if filled
+    // cells were pushed off the top (the player tops out).
+    bool addGarbage(int count, int holeColumn)
+    {
+        count = std::min(count, GRID_ROWS);
+        RowMask lost = 0;
+        for (int y = 0; y < count; ++y)
+            lost |= rows[y];
+        std::copy(rows.begin() + count, rows.end(), rows.begin());
+        const RowMask garbage = (RowMask)(FULL_ROW & ~(1u << holeColumn));
+        std::fill(rows.end() - count, rows.end(), garbage);
+        return lost == 0;
+    }
+};
+
+// Identifies the set of cells a placement covers, so that different
+// (rot, x, y) states ending in the same cells count once.
+inline uint64_t placementKey(const Placement &p)
+{
+    const PieceRotation &r = PIECES[p.piece].rotations[p.rot];
+    const int left = p.x + r.minX;
+    const int top = p.y + r.minY;
+    uint64_t key = (uint64_t)(top + 1) << 40;
+    for (int i = 0; i < r.height; ++i)
+        key |= (uint64_t)(RowMask)(r.rows[i] << left) << (10 * i);
+    return key;
+}
+
+// Enumerates every distinct resting position reachable from spawn with
+// left / right / soft drop / rotate moves. Returns false on top-out.
+inline bool generatePlacements(const Board &board, int piece, PlacementList &out)
+{
+    constexpr int PAD = 4;
+    constexpr int SPAN_X = GRID_COLS + 2 * PAD;
+    constexpr int SPAN_Y = GRID_ROWS + 2 * PAD;
+    constexpr int SEEN_SLOTS = 512;
+
+    out.clear();
+    const PieceDef &def = PIECES[piece];
+    if (board.collides(piece, 0, def.spawnX, def.spawnY))
+        return false;
+
+    bool visited[4][SPAN_Y][SPAN_X] = {};
+    uint64_t seen[SEEN_SLOTS] = {};
+    Placement stack[4 * SPAN_Y * SPAN_X];
+    int top = 0;
+
+    auto push = [&](int rot, int x, int y)
+    {
+        bool &v = visited[rot][y + PAD][x + PAD];
+        if (v)
+            return;
+        v = true;
+        stack[top++] = Placement{(int8_t)piece, (int8_t)rot, (int8_t)x, (int8_t)y};
+    };
+
+    push(0, def.spawnX, def.spawnY);
+    while (top > 0)
+    {
+        const Placement s = stack[--top];
+
+        if (!board.collides(piece, s.rot, s.x - 1, s.y))
+            push(s.rot, s.x - 1, s.y);
+        if (!board.collides(piece, s.rot, s.x + 1, s.y))
+            push(s.rot, s.x + 1, s.y);
+
+        if (piece != 0)
+        {
+            for (int dir = ROTATE_CW; dir <= ROTATE_CCW; ++dir)
+            {
+                int rot = s.rot;
+                int x = s.x;
+                int y = s.y;
+                if (board.tryRotate(piece, dir, rot, x, y))
+                    push(rot, x, y);
+            }
+        }
+
+        if (!board.collides(piece, s.rot, s.x, s.y + 1))
+        {
+            push(s.rot, s.x, s.y + 1);
+            continue;
+        }
+
+        const uint64_t key = placementKey(s);
+        uint32_t slot = (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 55);
+        while (seen[slot] != 0 && seen[slot] != key)
+            slot = (slot + 1) & (SEEN_SLOTS - 1);
+        if (seen[slot] == key)
+            continue;
+        seen[slot] = key;
+        out.push_back(s);
+    }
+    return true;
+}
+
+// splitmix64; small, fast and good enough for shuffling bags.
+struct Rng
+{
+    uint64_t state;
+
+    explicit Rng(uint64_t seed) : state(seed) {}
+
+    uint64_t next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    int below(int n) { return (int)(next() % (uint64_t)n); }
+};
+
+// Zobrist keys folded per row: entry [y][mask] is the XOR of the cell keys
+// of every bit set in mask, so a board hashes in one lookup per row.
+struct ZobristTable
+{
+    std::vector<uint64_t> rowKeys;
+
+    ZobristTable() : rowKeys((size_t)GRID_ROWS << GRID_COLS)
+    {
+        Rng rng(0x7E7A015ull);
+        for (int y = 0; y < GRID_ROWS; ++y)
+        {
+            uint64_t *keys = &rowKeys[(size_t)y << GRID_COLS];
+            for (int x = 0; x < GRID_COLS; ++x)
+                keys[1u << x] = rng.next();
+            for (uint32_t mask = 1; mask <= FULL_ROW; ++mask)
+                keys[mask] = keys[mask & (mask - 1)] ^ keys[mask & (0u - mask)];
+        }
+    }
+};
+
+inline uint64_t zobristHash(const Board &board)
+{
+    static const ZobristTable table;
+    uint64_t hash = 0;
+    for (int y = 0; y < GRID_ROWS; ++y)
+        hash ^= table.rowKeys[((size_t)y << GRID_COLS) | board.rows[y]];
+    return hash;
+}
+
+// 7-bag randomizer: every run of seven pieces contains each piece once.
+struct Bag
+{
+    Rng rng;
+    uint8_t pieces[PIECE_COUNT];
+    int remaining;
+
+    explicit Bag(uint64_t seed) : rng(seed), pieces{}, remaining(0) {}
+
+    int next()
+    {
+        if (remaining == 0)
+        {
+            for (int i = 0; i < PIECE_COUNT; ++i)
+                pieces[i] = (uint8_t)i;
+            for (int i = PIECE_COUNT - 1; i > 0; --i)
+                std::swap(pieces[i], pieces[rng.below(i + 1)]);
+            remaining = PIECE_COUNT;
+        }
+        return pieces[PIECE_COUNT - remaining--];
+    }
+
+    // Pieces still to come from the current bag, as a bit mask over piece indices.
+    uint32_t remainingMask() const
+    {
+        uint32_t mask = 0;
+        for (int i = PIECE_COUNT - remaining; i < PIECE_COUNT; ++i)
+            mask |= 1u << pieces[i];
+        return mask;
+    }
+};
+
+// Counts the distinct placement sequences for queue[0..depth).
+inline uint64_t perft(const Board &board, const uint8_t *queue, int depth)
+{
+    if (depth == 0)
+        return 1;
+
+    PlacementList placements;
+    generatePlacements(board, queue[0], placements);
+    if (depth == 1)
+        return (uint64_t)placements.size();
+
+    uint64_t count = 0;
+    for (const auto &p : placements)
+    {
+        Board next = board;
+        next.place(p);
+        next.clearLines();
+        count += perft(next, queue + 1, depth - 1);
+    }
+    return count;
+}
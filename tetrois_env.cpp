@@ -0,0 +1,251 @@
+// Batch environment behind tetrois_env.h. Each environment keeps its board,
+// bag and queue, plus the landing placement of every legal action so that a
+// step is one place() and clearLines(). Batches are cut into chunks of
+// environments that run as tasks on the work-stealing pool.
+//
+//   g++ -std=c++17 -O2 -pthread -shared -fPIC tetrois_env.cpp -o libtetrois_env.so
+
+#include "tetrois_env.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "tetrois_engine.hpp"
+#include "tetrois_pool.hpp"
+
+static_assert(TETROIS_ENV_ROWS == GRID_ROWS && TETROIS_ENV_COLS == GRID_COLS, "ABI grid size out of sync");
+static_assert(sizeof(tetrois_obs) == 48, "tetrois_obs layout changed");
+
+namespace
+{
+
+constexpr int QUEUE_LEN = 1 + TETROIS_ENV_PREVIEW;
+constexpr int CHUNK = 256; // environments per pool task
+
+struct Env
+{
+    Board board;
+    Bag bag{0};
+    Rng episodes{0}; // seeds the bag of each new episode
+    uint8_t queue[QUEUE_LEN];
+    int lines = 0;
+    Placement landing[TETROIS_ENV_ACTIONS]; // piece < 0: illegal action
+};
+
+// Refreshes the legal actions of e for its current piece: every (rot, column)
+// the piece can be shifted and rotated to (with kicks) without soft dropping,
+// then hard dropped. Returns false on top-out (no legal action).
+bool computeActions(Env &e)
+{
+    constexpr int PAD = 4;
+    constexpr int SPAN_X = GRID_COLS + 2 * PAD;
+    constexpr int SPAN_Y = GRID_ROWS + 2 * PAD;
+    static_assert(SPAN_X <= 32, "visited rows are 32-bit masks");
+
+    for (Placement &p : e.landing)
+        p.piece = -1;
+    const int piece = e.queue[0];
+    const PieceDef &def = PIECES[piece];
+    if (e.board.collides(piece, 0, def.spawnX, def.spawnY))
+        return false;
+
+    // Kicks move pieces by a row or two, so states are keyed by (rot, x, y).
+    uint32_t visited[4][SPAN_Y] = {};
+    Placement states[4 * SPAN_Y * SPAN_X];
+    int count = 0;
+    auto push = [&](int rot, int x, int y)
+    {
+        uint32_t &row = visited[rot][y + PAD];
+        const uint32_t bit = 1u << (x + PAD);
+        if (row & bit)
+            return;
+        row |= bit;
+        states[count++] = Placement{(int8_t)piece, (int8_t)rot, (int8_t)x, (int8_t)y};
+    };
+
+    push(0, def.spawnX, def.spawnY);
+    bool any = false;
+    for (int next = 0; next < count; ++next)
+    {
+        const Placement s = states[next];
+        if (!e.board.collides(piece, s.rot, s.x - 1, s.y))
+            push(s.rot, s.x - 1, s.y);
+        if (!e.board.collides(piece, s.rot, s.x + 1, s.y))
+            push(s.rot, s.x + 1, s.y);
+        if (piece != 0)
+        {
+            for (int dir = ROTATE_CW; dir <= ROTATE_CCW; ++dir)
+            {
+                int rot = s.rot;
+                int x = s.x;
+                int y = s.y;
+                if (e.board.tryRotate(piece, dir, rot, x, y))
+                    push(rot, x, y);
+            }
+        }
+
+        Placement &action = e.landing[s.rot * GRID_COLS + s.x + PIECES[piece].rotations[s.rot].minX];
+        if (action.piece >= 0)
+            continue;
+        action = s;
+        while (!e.board.collides(piece, action.rot, action.x, action.y + 1))
+            ++action.y;
+        any = true;
+    }
+    return any;
+}
+
+void startEpisode(Env &e)
+{
+    e.board = Board();
+    e.bag = Bag(e.episodes.next());
+    for (uint8_t &piece : e.queue)
+        piece = (uint8_t)e.bag.next();
+    e.lines = 0;
+    computeActions(e);
+}
+
+} // namespace
+
+struct tetrois_env
+{
+    std::vector<Env> envs;
+    std::unique_ptr<WorkStealingPool> pool;
+    tetrois_obs *obs = nullptr;
+    uint8_t *masks = nullptr;
+    float *rewards = nullptr;
+    uint8_t *dones = nullptr;
+
+    void write(int i)
+    {
+        const Env &e = envs[i];
+        if (obs != nullptr)
+        {
+            tetrois_obs &o = obs[i];
+            std::copy(e.board.rows.begin(), e.board.rows.end(), o.rows);
+            std::copy(e.queue, e.queue + QUEUE_LEN, o.queue);
+            o.bag_mask = (uint8_t)e.bag.remainingMask();
+            o.level = (uint8_t)std::min(255, e.lines / 10 + 1);
+        }
+        if (masks != nullptr)
+        {
+            uint8_t *m = masks + (size_t)i * TETROIS_ENV_ACTIONS;
+            for (int a = 0; a < TETROIS_ENV_ACTIONS; ++a)
+                m[a] = e.landing[a].piece >= 0;
+        }
+    }
+
+    void step(int i, int32_t action)
+    {
+        Env &e = envs[i];
+        float reward = 0;
+        bool done = action < 0 || action >= TETROIS_ENV_ACTIONS || e.landing[action].piece < 0;
+        if (!done)
+        {
+            e.board.place(e.landing[action]);
+            const int cleared = e.board.clearLines();
+            reward = (float)(LINE_SCORES[cleared] * (e.lines / 10 + 1));
+            e.lines += cleared;
+            std::copy(e.queue + 1, e.queue + QUEUE_LEN, e.queue);
+            e.queue[QUEUE_LEN - 1] = (uint8_t)e.bag.next();
+            done = !computeActions(e);
+        }
+        if (done)
+            startEpisode(e);
+        if (rewards != nullptr)
+            rewards[i] = reward;
+        if (dones != nullptr)
+            dones[i] = done;
+        write(i);
+    }
+
+    // Runs fn(i) for every environment, chunked over the pool.
+    template <typename Fn>
+    void forEach(const Fn &fn)
+    {
+        const int count = (int)envs.size();
+        if (!pool || count <= CHUNK)
+        {
+            for (int i = 0; i < count; ++i)
+                fn(i);
+            return;
+        }
+        WorkStealingPool::TaskGroup group;
+        for (int begin = 0; begin < count; begin += CHUNK)
+        {
+            const int end = std::min(count, begin + CHUNK);
+            pool->spawn(group, [&fn, begin, end]()
+            {
+                for (int i = begin; i < end; ++i)
+                    fn(i);
+            });
+        }
+        pool->wait(group);
+    }
+};
+
+extern "C" {
+
+tetrois_env *tetrois_env_create(int count, int threads, uint64_t seed)
+{
+    if (count < 1)
+        return nullptr;
+    // Nothing may throw out of the C ABI: running out of memory or threads
+    // returns NULL like bad arguments do.
+    std::unique_ptr<tetrois_env> env;
+    try
+    {
+        env.reset(new tetrois_env());
+        env->envs.resize(count);
+        if (threads > 1)
+            env->pool.reset(new WorkStealingPool(threads));
+        tetrois_env_reset(env.get(), seed);
+    }
+    catch (...)
+    {
+        return nullptr;
+    }
+    return env.release();
+}
+
+void tetrois_env_destroy(tetrois_env *env)
+{
+    delete env;
+}
+
+int tetrois_env_count(const tetrois_env *env)
+{
+    return (int)env->envs.size();
+}
+
+void tetrois_env_bind(tetrois_env *env, tetrois_obs *obs, uint8_t *masks, float *rewards, uint8_t *dones)
+{
+    env->obs = obs;
+    env->masks = masks;
+    env->rewards = rewards;
+    env->dones = dones;
+    env->forEach([env](int i) { env->write(i); });
+}
+
+void tetrois_env_reset(tetrois_env *env, uint64_t seed)
+{
+    env->forEach([env, seed](int i)
+    {
+        Env &e = env->envs[i];
+        e.episodes = Rng(Rng(seed + (uint64_t)i * 0x9E3779B97F4A7C15ull).next());
+        startEpisode(e);
+        if (env->rewards != nullptr)
+            env->rewards[i] = 0;
+        if (env->dones != nullptr)
+            env->dones[i] = 0;
+        env->write(i);
+    });
+}
+
+void tetrois_env_step(tetrois_env *env, const int32_t *actions)
+{
+    env->forEach([env, actions](int i) { env->step(i, actions[i]); });
+}
+
+} // extern "C"
@@ -0,0 +1,63 @@
+/*
+ * C ABI for a batch of Tetrois environments stepped together, for training
+ * policies against the game's own rules (SRS placements, 7-bag, scoring).
+ *
+ *   g++ -std=c++17 -O2 -pthread -shared -fPIC tetrois_env.cpp -o libtetrois_env.so
+ *
+ * The caller owns every buffer. After tetrois_env_bind() each reset and step
+ * writes observations, action masks, rewards and done flags for environment
+ * i straight into element i of those arrays, so nothing is copied on return.
+ *
+ * An action is a hard drop: index rot * TETROIS_ENV_COLS + column, where
+ * column is the leftmost column the piece covers in rotation rot. It is
+ * legal when that placement is reachable from spawn (the mask is 1). An
+ * illegal action, like a top-out, ends the episode; an environment whose
+ * episode ended restarts on its own, so its observation after a done step
+ * is the first one of the next episode.
+ */
+#ifndef TETROIS_ENV_H
+#define TETROIS_ENV_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TETROIS_ENV_ROWS 20
+#define TETROIS_ENV_COLS 10
+#define TETROIS_ENV_PREVIEW 5
+#define TETROIS_ENV_ACTIONS (4 * TETROIS_ENV_COLS)
+
+/* 48 bytes, no pointers: arrays of these can be handed to numpy as is. */
+typedef struct tetrois_obs
+{
+    uint16_t rows[TETROIS_ENV_ROWS];          /* bit x = column x, row 0 = top */
+    uint8_t queue[1 + TETROIS_ENV_PREVIEW];   /* current piece, then preview; 0..6 = OISZTLJ */
+    uint8_t bag_mask;                         /* pieces left in the 7-bag after the queue */
+    uint8_t level;
+} tetrois_obs;
+
+typedef struct tetrois_env tetrois_env;
+
+/* threads <= 1 steps on the calling thread. Returns NULL on bad arguments
+   or when memory or threads run out. */
+tetrois_env *tetrois_env_create(int count, int threads, uint64_t seed);
+void tetrois_env_destroy(tetrois_env *env);
+int tetrois_env_count(const tetrois_env *env);
+
+/* obs: count entries, masks: count * TETROIS_ENV_ACTIONS bytes, rewards and
+ * dones: count entries. Any of them may be NULL to skip that output. */
+void tetrois_env_bind(tetrois_env *env, tetrois_obs *obs, uint8_t *masks, float *rewards, uint8_t *dones);
+
+/* Starts a new episode in every environment (seeded from seed). */
+void tetrois_env_reset(tetrois_env *env, uint64_t seed);
+
+/* actions: count entries. Rewards are the points scored by the drop. */
+void tetrois_env_step(tetrois_env *env, const int32_t *actions);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
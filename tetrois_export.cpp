@@ -0,0 +1,371 @@
+// Self-play exporter: bot games on every core, streamed as fixed-stride
+// TrainingRecords (tetrois_record.hpp) into sharded files.
+//
+// Player threads fill 1 MB blocks of records and hand full blocks to one
+// writer thread per shard, through a queue two blocks deep (one being
+// written, one waiting), then continue in a free block. Every write is a
+// whole block. Time players spend waiting for a block is reported as
+// stall time: near zero means the disks keep up.
+//
+//   g++ -std=c++17 -O2 -pthread tetrois_export.cpp -o tetrois-export
+//   ./tetrois-export --games 1000 --shards 4 --out data/selfplay
+//   ./tetrois-export --games 200 --beam 16 --preview 2
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tetrois_engine.hpp"
+#include "tetrois_record.hpp"
+#include "tetrois_search.hpp"
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: tetrois-export [--games N] [--pieces MAX] [--seed S] [--threads T] [--shards K]\n"
+                 "                      [--block-kb KB] [--out PREFIX] [--beam WIDTH] [--preview N]\n"
+                 "                      [--expectimax DEPTH] [--weights FILE]\n"
+                 "  writes PREFIX-00000.bin .. PREFIX-<K-1>.bin, one writer thread per shard\n");
+}
+
+struct Block
+{
+    std::vector<TrainingRecord> records;
+    size_t used = 0;
+};
+
+// Blocks in flight: a free list shared by the players and one bounded queue
+// of full blocks per shard.
+class BlockPool
+{
+public:
+    BlockPool(int blocks, size_t recordsPerBlock, int shards) : queues(shards)
+    {
+        for (int i = 0; i < blocks; ++i)
+        {
+            storage.emplace_back(new Block());
+            storage.back()->records.resize(recordsPerBlock);
+            freeBlocks.push_back(storage.back().get());
+        }
+    }
+
+    Block *acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this]() { return !freeBlocks.empty(); });
+        Block *b = freeBlocks.back();
+        freeBlocks.pop_back();
+        b->used = 0;
+        return b;
+    }
+
+    void release(Block *b)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            freeBlocks.push_back(b);
+        }
+        changed.notify_all();
+    }
+
+    // Blocks while the shard already has QUEUE_DEPTH blocks waiting.
+    void submit(int shard, Block *b)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return (int)queues[shard].size() < QUEUE_DEPTH; });
+        queues[shard].push_back(b);
+        changed.notify_all();
+    }
+
+    // nullptr once the shard's queue is empty and close() was called.
+    Block *next(int shard)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&]() { return !queues[shard].empty() || closed; });
+        if (queues[shard].empty())
+            return nullptr;
+        Block *b = queues[shard].front();
+        queues[shard].pop_front();
+        changed.notify_all();
+        return b;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        changed.notify_all();
+    }
+
+private:
+    static constexpr int QUEUE_DEPTH = 2;
+
+    std::vector<std::unique_ptr<Block>> storage;
+    std::vector<Block *> freeBlocks;
+    std::vector<std::deque<Block *>> queues;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool closed = false;
+};
+
+static void writeShard(FILE *f, int shard, uint64_t seed, BlockPool &pool, uint64_t &written, bool &ok)
+{
+    ShardHeader header{};
+    std::memcpy(header.magic, SHARD_MAGIC, sizeof(header.magic));
+    header.version = SHARD_VERSION;
+    header.recordSize = sizeof(TrainingRecord);
+    header.shard = (uint32_t)shard;
+    header.seed = seed;
+    ok = std::fwrite(&header, sizeof(header), 1, f) == 1;
+
+    while (Block *b = pool.next(shard))
+    {
+        if (ok && b->used > 0)
+        {
+            ok = std::fwrite(b->records.data(), sizeof(TrainingRecord), b->used, f) == b->used;
+            written += b->used;
+        }
+        pool.release(b);
+    }
+
+    header.records = written;
+    ok = ok && std::fseek(f, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, f) == 1;
+    ok = std::fclose(f) == 0 && ok;
+}
+
+struct PlayerStats
+{
+    uint64_t records = 0;
+    uint64_t lines = 0;
+    double stallSecs = 0;
+};
+
+// Plays games until the shared counter runs out, like playHeadlessGame()
+// but keeping every decision. A game's records are buffered until it ends
+// so the outcome fields can be filled in, then copied into blocks.
+static void playGames(const BotConfig &config, int preview, int maxPieces, uint64_t seed, int games,
+                      std::atomic<int> &nextGame, int shards, int firstShard, BlockPool &pool,
+                      PlayerStats &stats)
+{
+    using Clock = std::chrono::steady_clock;
+    std::vector<TrainingRecord> game;
+    const int visible = std::min(preview + 1, RECORD_QUEUE);
+    Block *block = nullptr;
+    int shard = firstShard % shards;
+
+    auto take = [&]()
+    {
+        const auto start = Clock::now();
+        block = pool.acquire();
+        stats.stallSecs += std::chrono::duration<double>(Clock::now() - start).count();
+    };
+    auto hand = [&]()
+    {
+        const auto start = Clock::now();
+        pool.submit(shard, block);
+        stats.stallSecs += std::chrono::duration<double>(Clock::now() - start).count();
+        shard = (shard + 1) % shards;
+        block = nullptr;
+    };
+
+    for (int g = nextGame.fetch_add(1); g < games; g = nextGame.fetch_add(1))
+    {
+        Board board;
+        Bag bag(seed + (uint64_t)g);
+        uint8_t queue[RECORD_QUEUE];
+        for (uint8_t &p : queue)
+            p = (uint8_t)bag.next();
+        game.clear();
+        bool toppedOut = false;
+
+        while ((int)game.size() < maxPieces)
+        {
+            const SearchResult move = chooseMove(board, queue, visible, bag.remainingMask(), config);
+            if (!move.found)
+            {
+                toppedOut = true;
+                break;
+            }
+            TrainingRecord r{};
+            std::copy(board.rows.begin(), board.rows.end(), r.rows);
+            std::copy(queue, queue + RECORD_QUEUE, r.queue);
+            r.bagMask = (uint8_t)bag.remainingMask();
+            r.rot = move.best.rot;
+            r.x = move.best.x;
+            r.y = move.best.y;
+            r.game = (uint32_t)g;
+            r.move = (uint16_t)std::min<size_t>(game.size(), 0xFFFF);
+
+            board.place(move.best);
+            r.linesCleared = (uint8_t)board.clearLines();
+            game.push_back(r);
+            std::copy(queue + 1, queue + RECORD_QUEUE, queue);
+            queue[RECORD_QUEUE - 1] = (uint8_t)bag.next();
+        }
+
+        uint32_t linesAfter = 0;
+        for (size_t i = game.size(); i-- > 0;)
+        {
+            linesAfter += game[i].linesCleared;
+            game[i].linesAfter = linesAfter;
+            game[i].movesLeft = (uint16_t)std::min<size_t>(game.size() - 1 - i, 0xFFFF);
+            game[i].flags = toppedOut ? RECORD_TOPPED_OUT : 0;
+        }
+        stats.lines += linesAfter;
+
+        for (size_t i = 0; i < game.size();)
+        {
+            if (block == nullptr)
+                take();
+            const size_t n = std::min(game.size() - i, block->records.size() - block->used);
+            std::copy(game.begin() + i, game.begin() + i + n, block->records.begin() + block->used);
+            block->used += n;
+            i += n;
+            stats.records += n;
+            if (block->used == block->records.size())
+                hand();
+        }
+    }
+    if (block != nullptr)
+        hand();
+}
+
+int main(int argc, char **argv)
+{
+    int games = 100;
+    int maxPieces = 2000;
+    uint64_t seed = 1;
+    int threads = (int)std::thread::hardware_concurrency();
+    int shards = 2;
+    int blockKb = 1024;
+    int preview = 1;
+    std::string prefix = "selfplay";
+    BotConfig config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--games") && hasValue)
+            games = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--pieces") && hasValue)
+            maxPieces = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--seed") && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--threads") && hasValue)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--shards") && hasValue)
+            shards = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--block-kb") && hasValue)
+            blockKb = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--out") && hasValue)
+            prefix = argv[++i];
+        else if (!std::strcmp(arg, "--beam") && hasValue)
+            config.beamWidth = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--preview") && hasValue)
+            preview = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--expectimax") && hasValue)
+            config.expectimaxDepth = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--weights") && hasValue)
+        {
+            if (!loadWeights(argv[++i], config.weights))
+            {
+                std::fprintf(stderr, "cannot read weights from %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    threads = std::max(1, threads);
+    shards = std::max(1, shards);
+    maxPieces = std::min(maxPieces, 0xFFFF);
+    const size_t recordsPerBlock = std::max<size_t>(1, (size_t)blockKb * 1024 / sizeof(TrainingRecord));
+
+    std::vector<FILE *> files(shards);
+    for (int s = 0; s < shards; ++s)
+    {
+        char path[4096];
+        std::snprintf(path, sizeof(path), "%s-%05d.bin", prefix.c_str(), s);
+        files[s] = std::fopen(path, "wb");
+        if (files[s] == nullptr)
+        {
+            std::fprintf(stderr, "cannot create %s\n", path);
+            return 1;
+        }
+        std::setvbuf(files[s], nullptr, _IONBF, 0); // blocks are already large writes
+    }
+
+    // Every player holds one block and every shard queues two more behind
+    // the one being written.
+    BlockPool pool(threads + 3 * shards, recordsPerBlock, shards);
+    std::vector<uint64_t> written(shards, 0);
+    std::vector<char> writeOk(shards, 0);
+    std::vector<std::thread> writers;
+    for (int s = 0; s < shards; ++s)
+    {
+        writers.emplace_back([&, s]()
+        {
+            bool ok = false;
+            writeShard(files[s], s, seed, pool, written[s], ok);
+            writeOk[s] = ok;
+        });
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic<int> nextGame{0};
+    std::vector<PlayerStats> stats(threads);
+    std::vector<std::thread> players;
+    for (int t = 0; t < threads; ++t)
+    {
+        players.emplace_back([&, t]()
+        {
+            playGames(config, preview, maxPieces, seed, games, nextGame, shards, t, pool, stats[t]);
+        });
+    }
+    for (auto &p : players)
+        p.join();
+    pool.close();
+    for (auto &w : writers)
+        w.join();
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    PlayerStats total;
+    for (const PlayerStats &s : stats)
+    {
+        total.records += s.records;
+        total.lines += s.lines;
+        total.stallSecs += s.stallSecs;
+    }
+    const double mb = total.records * sizeof(TrainingRecord) / (1024.0 * 1024.0);
+    std::printf("%d games, %llu records (%.1f MB) in %zu shards, %.2f s\n", games,
+                (unsigned long long)total.records, mb, files.size(), secs);
+    std::printf("  %.0f records/s, %.1f MB/s, %llu lines, players stalled on I/O %.1f%% of the time\n",
+                secs > 0 ? total.records / secs : 0.0, secs > 0 ? mb / secs : 0.0,
+                (unsigned long long)total.lines, secs > 0 ? 100.0 * total.stallSecs / (secs * threads) : 0.0);
+
+    for (int s = 0; s < shards; ++s)
+    {
+        if (!writeOk[s])
+        {
+            std::fprintf(stderr, "writing shard %d failed\n", s);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include "tetrois_engine.hpp"
+
+// Headless single-player rules: the falling piece, gravity, locking, scoring
+// and the 7-bag, driven by inputs and fixed ticks of 1/TICK_HZ s. The
+// ncurses game and tetrois-server both run on it. It owns no pointers, so copying a
+// GameState snapshots the game. In versus play (tetrois-versus) line clears
+// also send garbage rows, which rise from the bottom when the next piece
+// locks without clearing.
+
+enum class Input : uint8_t
+{
+    Left,
+    Right,
+    SoftDrop,
+    RotateCW,
+    RotateCCW,
+    HardDrop,
+};
+
+// Cell value of garbage rows, drawn in the last piece colour.
+constexpr uint8_t GARBAGE_CELL = PIECE_COUNT;
+
+// The rules run in fixed ticks, so a game's timing depends only on how many
+// ticks it has run, never on how long a frame took to draw.
+constexpr int TICK_HZ = 60;
+
+// Gravity is counted in 1/ROW_UNITS of a row per tick (1G = one row per
+// tick), so slow levels move a fraction of a row each tick.
+constexpr int32_t ROW_UNITS = 1 << 16;
+constexpr int32_t MAX_GRAVITY = 20 * ROW_UNITS; // 20G: the piece lands on the tick it spawns
+
+// Per level, from the guideline curve of (0.8 - (level - 1) * 0.007)^(level - 1)
+// seconds per row, rounded up; level 19 and up is 20G.
+constexpr int32_t GRAVITY[19] = {0,     1093,  1378,  1769,  2311,  3076,   4169,   5759,   8107,  11635,
+                                 17027, 25416, 38709, 60169, 95484, 154743, 256187, 433425, 749597};
+
+inline int32_t gravityFor(int level)
+{
+    return level < 19 ? GRAVITY[std::max(level, 1)] : MAX_GRAVITY;
+}
+
+// A piece resting on the stack locks after this many ticks without moving.
+// Shifts and rotations restart the count, at most MAX_LOCK_RESETS times
+// before the piece reaches a new lowest row, so it cannot be spun forever.
+constexpr int LOCK_DELAY_TICKS = 30;
+constexpr int MAX_LOCK_RESETS = 15;
+
+// Maps wall-clock time to whole ticks for a real-time front end. Tick k is
+// due at start + k / TICK_HZ s, however late the loop gets to it, so a slow
+// frame makes the next loop run more ticks rather than longer ones.
+struct TickClock
+{
+    using Clock = std::chrono::steady_clock;
+
+    Clock::time_point start;
+    uint64_t ticks = 0; // ticks handed out so far
+
+    explicit TickClock(Clock::time_point start = Clock::now()) : start(start) {}
+
+    Clock::time_point at(uint64_t tick) const
+    {
+        return start + std::chrono::microseconds((int64_t)(tick * 1000000 / TICK_HZ));
+    }
+
+    // The ticks due by now that have not been handed out yet.
+    int due(Clock::time_point now)
+    {
+        if (now < start)
+            return 0;
+        const uint64_t target = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(now - start).count() *
+                                TICK_HZ / 1000000;
+        const int n = target > ticks ? (int)(target - ticks) : 0;
+        ticks = std::max(ticks, target);
+        return n;
+    }
+};
+
+struct GameState
+{
+    Board board;
+    uint8_t cells[GRID_ROWS][GRID_COLS]; // piece index + 1 of every locked cell, 0 = empty
+    Bag bag;
+    Placement current; // the falling piece
+    int next;          // piece index shown in the preview
+    bool over = false;
+    int score = 0;
+    int level = 1;
+    int lines = 0;
+    int32_t gravity = gravityFor(1); // ROW_UNITS per tick
+    int32_t fall = 0;                // progress towards the next row, in ROW_UNITS
+    int lockTicks = 0;               // ticks the piece has rested on the stack
+    int lockResets = 0;              // moves that restarted lockTicks since lowestY
+    int lowestY = 0;                 // lowest row the piece has reached
+    uint32_t pieces = 0;             // pieces locked so far
+    Rng holes;           // garbage hole columns
+    int pendingGarbage = 0;  // rows sent to us that have not risen yet
+    int outgoingGarbage = 0; // rows we sent that the match has not delivered yet
+
+    explicit GameState(uint64_t seed = 0) : cells{}, bag(seed), holes(seed ^ 0x6A7BA6Eull)
+    {
+        current = spawn(bag.next());
+        lowestY = current.y;
+        next = bag.next();
+    }
+
+    static Placement spawn(int piece)
+    {
+        return Placement{(int8_t)piece, 0, PIECES[piece].spawnX, PIECES[piece].spawnY};
+    }
+
+    // Returns false if the input had no effect.
+    bool apply(Input input)
+    {
+        if (over)
+            return false;
+        switch (input)
+        {
+        case Input::Left:
+            return shift(-1, 0) && moved();
+        case Input::Right:
+            return shift(1, 0) && moved();
+        case Input::SoftDrop:
+            return shift(0, 1) && moved();
+        case Input::RotateCW:
+        case Input::RotateCCW:
+        {
+            int rot = current.rot;
+            int x = current.x;
+            int y = current.y;
+            if (!board.tryRotate(current.piece, input == Input::RotateCW ? ROTATE_CW : ROTATE_CCW, rot, x, y))
+                return false;
+            current.rot = (int8_t)rot;
+            current.x = (int8_t)x;
+            current.y = (int8_t)y;
+            return moved();
+        }
+        case Input::HardDrop:
+            current = ghost();
+            lock();
+            return true;
+        }
+        return false;
+    }
+
+    // Runs `ticks` fixed ticks. Each adds gravity to the fall, which moves
+    // the piece down a row per ROW_UNITS (up to 20 rows at 20G); a piece on
+    // the stack counts towards its lock delay instead. Returns false if
+    // nothing moved.
+    bool advance(int ticks)
+    {
+        bool changed = false;
+        for (int t = 0; t < ticks && !over; ++t)
+        {
+            fall += gravity;
+            while (fall >= ROW_UNITS && shift(0, 1))
+            {
+                fall -= ROW_UNITS;
+                moved();
+                changed = true;
+            }
+            if (!grounded())
+                continue;
+            fall = 0;
+            if (++lockTicks >= LOCK_DELAY_TICKS)
+            {
+                lock();
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // Ticks until advance() would next change the game by itself, or -1 if
+    // it never will (the game is over). Lets a server sleep until the next
+    // deadline instead of polling every session.
+    int nextEventTicks() const
+    {
+        if (over)
+            return -1;
+        if (grounded())
+            return LOCK_DELAY_TICKS - lockTicks;
+        return (ROW_UNITS - fall + gravity - 1) / gravity;
+    }
+
+    bool grounded() const
+    {
+        return board.collides(current.piece, current.rot, current.x, current.y + 1);
+    }
+
+    // Moves the falling piece straight to p (a placement of the same piece,
+    // e.g. from the bot) and locks it there.
+    void place(const Placement &p)
+    {
+        if (over)
+            return;
+        current = p;
+        lock();
+    }
+
+    // Queues garbage rows sent by an opponent.
+    void receiveGarbage(int rows)
+    {
+        if (!over)
+            pendingGarbage += rows;
+    }
+
+    // Everything the rules depend on, folded into 64 bits, so peers running
+    // the same inputs can check they still agree. The cell colours follow
+    // from the rest and are left out.
+    uint64_t hash() const
+    {
+        uint64_t h = zobristHash(board);
+        auto mix = [&h](uint64_t v)
+        {
+            h = (h ^ v) * 0x100000001B3ull;
+            h ^= h >> 29;
+        };
+        mix((uint64_t)(uint8_t)current.piece | (uint64_t)(uint8_t)current.rot << 8 |
+            (uint64_t)(uint8_t)current.x << 16 | (uint64_t)(uint8_t)current.y << 24 | (uint64_t)next << 32 |
+            (uint64_t)over << 40);
+        mix(bag.rng.state);
+        mix(bag.remainingMask() | (uint64_t)bag.remaining << 8);
+        mix(holes.state);
+        mix((uint64_t)(uint32_t)score | (uint64_t)(uint32_t)lines << 32);
+        mix((uint64_t)(uint32_t)fall | (uint64_t)pieces << 32);
+        mix((uint64_t)(uint32_t)lockTicks | (uint64_t)(uint32_t)lockResets << 20 | (uint64_t)(uint32_t)lowestY << 40);
+        mix((uint64_t)(uint32_t)pendingGarbage | (uint64_t)(uint32_t)outgoingGarbage << 32);
+        return h;
+    }
+
+    // Where the falling piece would land if hard dropped.
+    Placement ghost() const
+    {
+        Placement g = current;
+        while (!board.collides(g.piece, g.rot, g.x, g.y + 1))
+            ++g.y;
+        return g;
+    }
+
+private:
+    bool shift(int dx, int dy)
+    {
+        if (board.collides(current.piece, current.rot, current.x + dx, current.y + dy))
+            return false;
+        current.x = (int8_t)(current.x + dx);
+        current.y = (int8_t)(current.y + dy);
+        return true;
+    }
+
+    // After the piece moved: reaching a new lowest row starts the lock
+    // delay afresh, any other move restarts it while resets remain.
+    bool moved()
+    {
+        if (current.y > lowestY)
+        {
+            lowestY = current.y;
+            lockResets = 0;
+            lockTicks = 0;
+        }
+        else if (lockTicks > 0 && lockResets < MAX_LOCK_RESETS)
+        {
+            ++lockResets;
+            lockTicks = 0;
+        }
+        return true;
+    }
+
+    void lock()
+    {
+        const PieceRotation &r = PIECES[current.piece].rotations[current.rot];
+        for (int i = 0; i < 4; ++i)
+            cells[current.y + r.cellY[i]][current.x + r.cellX[i]] = (uint8_t)(current.piece + 1);
+        board.place(current);
+        ++pieces;
+
+        int target = GRID_ROWS - 1;
+        for (int y = GRID_ROWS - 1; y >= 0; --y)
+        {
+            if (board.rows[y] == FULL_ROW)
+                continue;
+            if (target != y)
+                std::copy(cells[y], cells[y] + GRID_COLS, cells[target]);
+            --target;
+        }
+        for (int y = 0; y <= target; ++y)
+            std::fill(cells[y], cells[y] + GRID_COLS, 0);
+
+        const int cleared = board.clearLines();
+        if (cleared > 0)
+        {
+            score += LINE_SCORES[cleared] * level;
+            lines += cleared;
+            level = lines / 10 + 1;
+            gravity = gravityFor(level);
+        }
+
+        // Clears cancel garbage still waiting for us before any is sent; a
+        // piece that clears nothing lets the waiting garbage rise.
+        const int sent = GARBAGE_LINES[cleared];
+        const int cancelled = std::min(sent, pendingGarbage);
+        pendingGarbage -= cancelled;
+        outgoingGarbage += sent - cancelled;
+        if (cleared == 0 && pendingGarbage > 0)
+            raiseGarbage();
+
+        current = spawn(next);
+        next = bag.next();
+        fall = 0;
+        lockTicks = 0;
+        lockResets = 0;
+        lowestY = current.y;
+        over = over || board.collides(current.piece, current.rot, current.x, current.y);
+    }
+
+    // The pending rows push the stack up, one bitboard row shift, with a
+    // single hole column shared by the batch. Cells pushed off the top end
+    // the game.
+    void raiseGarbage()
+    {
+        const int rows = std::min(pendingGarbage, GRID_ROWS);
+        const int hole = holes.below(GRID_COLS);
+        pendingGarbage = 0;
+        if (!board.addGarbage(rows, hole))
+            over = true;
+        std::memmove(cells[0], cells[rows], sizeof(cells[0]) * (GRID_ROWS - rows));
+        for (int y = GRID_ROWS - rows; y < GRID_ROWS; ++y)
+        {
+            for (int x = 0; x < GRID_COLS; ++x)
+                cells[y][x] = x == hole ? 0 : GARBAGE_CELL;
+        }
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "tetrois_engine.hpp"
+#include "tetrois_search.hpp"
+#include "tetrois_tt.hpp"
+
+// Best-move hints for a human player. The game thread posts a snapshot of
+// the position and looks the answer up later; a worker thread searches the
+// snapshot and files the move under the position's key. Neither call waits:
+// a post that finds the worker busy copying a job is retried next frame, and
+// a lookup is one probe of a lock-free table.
+class HintWorker
+{
+public:
+    explicit HintWorker(const BotConfig &config)
+        : config(config), cache(1), thread([this]() { threadLoop(); }) {}
+
+    ~HintWorker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeup.notify_one();
+        thread.join();
+    }
+
+    HintWorker(const HintWorker &) = delete;
+    HintWorker &operator=(const HintWorker &) = delete;
+
+    // Position key: board, current piece, preview and bag contents.
+    static uint64_t key(const Board &board, const uint8_t *queue, int queueLen, uint32_t bagMask)
+    {
+        uint64_t z = (uint64_t)bagMask << 48 ^ 0x4817C0DEull;
+        for (int i = 0; i < queueLen; ++i)
+            z = z * 31 + queue[i] + 1;
+        z = (z ^ (z >> 29)) * 0xBF58476D1CE4E5B9ull;
+        return zobristHash(board) ^ z;
+    }
+
+    // Asks for a hint on this position unless one is cached or on its way.
+    void post(const Board &board, const uint8_t *queue, int queueLen, uint32_t bagMask)
+    {
+        const uint64_t k = key(board, queue, queueLen, bagMask);
+        if (k == lastPosted)
+            return;
+        TableEntry cached;
+        if (cache.probe(k, cached))
+        {
+            lastPosted = k;
+            return;
+        }
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+            return;
+        job.board = board;
+        job.queueLen = std::min(queueLen, MAX_QUEUE);
+        std::copy(queue, queue + job.queueLen, job.queue);
+        job.bagMask = bagMask;
+        job.key = k;
+        pending = true;
+        lock.unlock();
+        wakeup.notify_one();
+        lastPosted = k;
+    }
+
+    // The hint for this position, if the worker has finished it.
+    bool lookup(const Board &board, const uint8_t *queue, int queueLen, uint32_t bagMask, Placement &out) const
+    {
+        TableEntry cached;
+        if (!cache.probe(key(board, queue, queueLen, bagMask), cached) || cached.best.piece != queue[0])
+            return false;
+        out = cached.best;
+        return true;
+    }
+
+private:
+    static constexpr int MAX_QUEUE = 8;
+
+    struct Job
+    {
+        Board board;
+        uint8_t queue[MAX_QUEUE];
+        int queueLen = 0;
+        uint32_t bagMask = 0;
+        uint64_t key = 0;
+    };
+
+    const BotConfig config;
+    SharedTranspositionTable cache;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    Job job;
+    bool pending = false;
+    bool stopping = false;
+    uint64_t lastPosted = 0; // game thread only
+    std::thread thread;
+
+    void threadLoop()
+    {
+        while (true)
+        {
+            Job current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this]() { return pending || stopping; });
+                if (stopping)
+                    return;
+                current = job;
+                pending = false;
+            }
+            const SearchResult result = chooseMove(current.board, current.queue, current.queueLen, current.bagMask,
+                                                   config);
+            // A position that tops out is cached too, with no move, so it is not searched again.
+            Placement best = result.best;
+            if (!result.found)
+                best.piece = -1;
+            cache.store(current.key, TableEntry{result.score, best, result.depth});
+        }
+    }
+};
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "tetrois_engine.hpp"
+
+// Keyboard input for the terminal game: a decoder for what the terminal
+// sends, including the kitty keyboard protocol's press/repeat/release
+// events, and DAS/ARR auto-shift for the horizontal keys timed on our own
+// clock instead of the terminal's key repeat.
+//
+// Terminals that speak the kitty protocol (kitty, foot, WezTerm, Ghostty,
+// recent Alacritty and others) answer CSI ? u with their current flags;
+// the game then pushes flags 1|2|8 (disambiguate, report event types,
+// report every key as an escape code) so that key releases arrive too.
+// Elsewhere a held key only shows up as the terminal's auto-repeat, so a
+// key counts as held while repeats keep coming faster than the release
+// timeout, and as released once they stop.
+
+constexpr char KITTY_QUERY[] = "\x1b[?u\x1b[c"; // flags query, then DA1 so non-kitty terminals answer too
+constexpr char KITTY_PUSH[] = "\x1b[>11u";
+constexpr char KITTY_POP[] = "\x1b[<u";
+
+// Key codes beyond the byte range for the arrow keys.
+constexpr int ARROW_UP = 0x101;
+constexpr int ARROW_DOWN = 0x102;
+constexpr int ARROW_RIGHT = 0x103;
+constexpr int ARROW_LEFT = 0x104;
+
+enum class KeyAction : uint8_t
+{
+    Press,
+    Repeat,
+    Release,
+};
+
+struct KeyEvent
+{
+    int key; // the character, lowercased, or an ARROW_ code
+    KeyAction action;
+};
+
+// Splits terminal bytes into key events. Without the kitty protocol every
+// key is a Press, auto-repeat included.
+class KeyDecoder
+{
+public:
+    bool kittySupported = false; // the terminal answered the flags query
+
+    // Feeds one byte. Returns true and fills e when it completes a key.
+    bool feed(uint8_t c, KeyEvent &e)
+    {
+        switch (state)
+        {
+        case State::Text:
+            if (c == 0x1b)
+            {
+                state = State::Escape;
+                return false;
+            }
+            e = KeyEvent{lower(c), KeyAction::Press};
+            return true;
+        case State::Escape:
+            if (c == '[' || c == 'O')
+            {
+                state = State::Csi;
+                length = 0;
+                return false;
+            }
+            // A lone ESC followed by a key, e.g. Alt+key: keep the key.
+            state = c == 0x1b ? State::Escape : State::Text;
+            if (c == 0x1b)
+                return false;
+            e = KeyEvent{lower(c), KeyAction::Press};
+            return true;
+        case State::Csi:
+            if (c < 0x40 || c > 0x7e)
+            {
+                if (length < sizeof(params))
+                    params[length++] = (char)c;
+                return false;
+            }
+            state = State::Text;
+            return finish(c, e);
+        }
+        return false;
+    }
+
+private:
+    enum class State : uint8_t
+    {
+        Text,
+        Escape,
+        Csi, // after ESC [ or ESC O, collecting parameters until the final byte
+    };
+
+    State state = State::Text;
+    char params[32];
+    size_t length = 0;
+
+    static int lower(int c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+    // The numbers in "code[:alternates];modifiers[:event]", -1 where absent.
+    void parse(int &code, int &event) const
+    {
+        code = -1;
+        event = -1;
+        int field = 0;
+        int sub = 0;
+        int value = -1;
+        auto store = [&]()
+        {
+            if (field == 0 && sub == 0)
+                code = value;
+            else if (field == 1 && sub == 1)
+                event = value;
+        };
+        for (size_t i = 0; i < length; ++i)
+        {
+            const char ch = params[i];
+            if (ch >= '0' && ch <= '9')
+                value = (value < 0 ? 0 : value * 10) + (ch - '0');
+            else
+            {
+                store();
+                value = -1;
+                if (ch == ';')
+                {
+                    ++field;
+                    sub = 0;
+                }
+                else if (ch == ':')
+                    ++sub;
+            }
+        }
+        store();
+    }
+
+    bool finish(uint8_t final, KeyEvent &e)
+    {
+        if (length > 0 && params[0] == '?')
+        {
+            // CSI ? flags u answers the kitty query; CSI ? ... c is DA1.
+            if (final == 'u')
+                kittySupported = true;
+            return false;
+        }
+        int code;
+        int event;
+        parse(code, event);
+        const KeyAction action = event == 2 ? KeyAction::Repeat : event == 3 ? KeyAction::Release : KeyAction::Press;
+        switch (final)
+        {
+        case 'u':
+            if (code < 0)
+                return false;
+            e = KeyEvent{lower(code), action};
+            return true;
+        case 'A':
+            e = KeyEvent{ARROW_UP, action};
+            return true;
+        case 'B':
+            e = KeyEvent{ARROW_DOWN, action};
+            return true;
+        case 'C':
+            e = KeyEvent{ARROW_RIGHT, action};
+            return true;
+        case 'D':
+            e = KeyEvent{ARROW_LEFT, action};
+            return true;
+        }
+        return false;
+    }
+};
+
+struct AutoShiftConfig
+{
+    int dasMs = 167;    // held this long before auto-shift starts
+    int arrMs = 33;     // then one column per arrMs; 0 = straight to the wall
+    int releaseMs = 60; // without release events: a key whose repeats stop for this long is up
+};
+
+// DAS/ARR for left and right. The most recently pressed direction wins
+// while both are held. Shifts fall due on the steady clock, not on game
+// ticks or the terminal's repeat rate, so the lateral speed is the same
+// whatever the frame rate.
+class AutoShift
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // With release events (kitty protocol) held keys are known exactly;
+    // otherwise the release timeout stands in for them.
+    bool releaseEvents = false;
+
+    explicit AutoShift(const AutoShiftConfig &config) : config(config) {}
+
+    // A press of dir (-1 left, 1 right); without release events possibly
+    // a terminal repeat. Returns true if the piece should shift once now,
+    // as on every fresh press.
+    bool press(int dir, Clock::time_point now)
+    {
+        Key &k = keys[index(dir)];
+        if (releaseEvents)
+        {
+            k.firstPress = now;
+            k.nextShift = now + ms(config.dasMs);
+            k.held = true;
+            active = dir;
+            return true;
+        }
+        const auto gap = now - k.lastSeen;
+        k.lastSeen = now;
+        if (gap <= ms(config.releaseMs))
+        {
+            // Repeats coming faster than anyone taps: the key is held.
+            if (!k.held)
+            {
+                k.held = true;
+                k.nextShift = std::max(k.firstPress + ms(config.dasMs), now);
+            }
+            return false;
+        }
+        // A terminal's first auto-repeat comes a few hundred ms after the
+        // press and looks like a fresh press, so DAS counts from the
+        // press before it.
+        if (gap > ms(REPEAT_DELAY_MS))
+            k.firstPress = now;
+        k.held = false;
+        active = dir;
+        return true;
+    }
+
+    void release(int dir, Clock::time_point now)
+    {
+        keys[index(dir)].held = false;
+        if (active == dir)
+            resume(-dir, now);
+    }
+
+    // Shifts due by now in the active direction: sets dir and returns the
+    // count, or at ARR 0 enough to reach the wall.
+    int due(Clock::time_point now, int &dir)
+    {
+        expire(now);
+        dir = active;
+        if (dir == 0)
+            return 0;
+        Key &k = keys[index(dir)];
+        if (!k.held || now < k.nextShift)
+            return 0;
+        if (config.arrMs <= 0)
+            return GRID_COLS;
+        const auto arr = ms(config.arrMs);
+        const int count = 1 + (int)((now - k.nextShift) / arr);
+        k.nextShift += arr * count;
+        return count;
+    }
+
+    // When due() next has work, or a held key times out, so the caller can
+    // sleep until then; time_point::max() if nothing is pending. Once ARR 0
+    // has charged, the shift only needs repeating when the game changes.
+    Clock::time_point nextDeadline(Clock::time_point now) const
+    {
+        Clock::time_point at = Clock::time_point::max();
+        if (!releaseEvents)
+        {
+            for (const Key &k : keys)
+            {
+                if (k.held)
+                    at = std::min(at, k.lastSeen + ms(config.releaseMs) + std::chrono::microseconds(1));
+            }
+        }
+        if (active != 0)
+        {
+            const Key &k = keys[index(active)];
+            if (k.held && (config.arrMs > 0 || now < k.nextShift))
+                at = std::min(at, k.nextShift);
+        }
+        return at;
+    }
+
+private:
+    static constexpr int REPEAT_DELAY_MS = 700; // longer than a terminal's usual delay before auto-repeat
+
+    struct Key
+    {
+        bool held = false; // auto-shift may run
+        Clock::time_point firstPress;
+        Clock::time_point lastSeen; // without release events: the last press or repeat
+        Clock::time_point nextShift;
+    };
+
+    AutoShiftConfig config;
+    Key keys[2];
+    int active = 0;
+
+    static int index(int dir) { return dir < 0 ? 0 : 1; }
+
+    static std::chrono::milliseconds ms(int n) { return std::chrono::milliseconds(n); }
+
+    // Without release events, a held key whose repeats have stopped is up.
+    void expire(Clock::time_point now)
+    {
+        if (releaseEvents)
+            return;
+        for (int dir : {-1, 1})
+        {
+            const Key &k = keys[index(dir)];
+            if (k.held && now - k.lastSeen > ms(config.releaseMs))
+                release(dir, now);
+        }
+    }
+
+    // The other key takes over when the active one goes up: at once if it
+    // had already charged, otherwise when its DAS runs out.
+    void resume(int dir, Clock::time_point now)
+    {
+        Key &k = keys[index(dir)];
+        if (!k.held)
+        {
+            active = 0;
+            return;
+        }
+        active = dir;
+        k.nextShift = std::max(k.firstPress + ms(config.dasMs), now);
+    }
+};
@@ -0,0 +1,453 @@
+// Load generator for tetrois-server: opens many sessions, types into them
+// open-loop at a fixed rate and measures how quickly frames come back.
+//
+// Every session sends keys on its own fixed schedule, whether or not the
+// server has answered, so a slow server cannot slow the load down. Each
+// hard drop sent while no probe is outstanding is followed by a ctrl-l, and
+// is a latency probe: the time from when it was *due* (not when the client
+// got round to sending it) to the repaint that answers the ctrl-l, which
+// starts with a clear screen that nothing else sends. Frames for earlier
+// keys or gravity arriving in between are not mistaken for the reply, and
+// a slow client shows up as latency too, rather than hiding it. The
+// repaints are counted in the bytes received.
+//
+// Keys come from a random mix, from a bot playing its own local game (real
+// rotate / shift / drop sequences), or from a replayed file. With several
+// --rate steps the run reports where the server saturates: the first step
+// whose p99 latency exceeds --slo-ms or whose achieved rate falls short.
+//
+//   g++ -std=c++17 -O2 -pthread tetrois_loadgen.cpp -o tetrois-loadgen
+//   ./tetrois-loadgen --sessions 2000 --rate 2,5,10,20 --duration 10
+//   ./tetrois-loadgen --unix /tmp/tetrois.sock --sessions 500 --input bot
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tetrois_game.hpp"
+#include "tetrois_search.hpp"
+#include "tetrois_timer.hpp"
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: tetrois-loadgen [--host ADDR] [--port N] [--unix PATH] [--sessions N] [--threads T]\n"
+                 "                       [--rate R[,R...]] [--duration SECS] [--input random|bot|FILE]\n"
+                 "                       [--slo-ms MS] [--seed S]\n"
+                 "  --rate is keys per second per session; each value is one step of --duration seconds\n");
+}
+
+using Clock = std::chrono::steady_clock;
+
+enum class InputMode
+{
+    Random,
+    Bot,
+    Replay,
+};
+
+struct Client
+{
+    int fd = -1;
+    TimerNode timer;
+    double period = 0;        // seconds between keys
+    Clock::time_point due;    // when the next key should go out
+    bool probing = false;     // a probe is waiting for its repaint
+    Clock::time_point probeDue;
+    size_t replyMatched = 0;  // bytes of PROBE_REPLY seen so far
+
+    // Key source
+    Rng rng{0};
+    std::unique_ptr<GameState> game; // --input bot: the local game the keys play
+    std::string keys;                // keys queued for the current piece
+    size_t replayPos = 0;
+};
+
+struct StepStats
+{
+    uint64_t sent = 0;
+    uint64_t received = 0;
+    uint64_t late = 0; // keys sent more than a period after they were due
+    LatencyHistogram latency; // microseconds
+};
+
+static std::vector<char> replayKeys;
+
+// The keys a player would type to put the current piece where the bot
+// wants it: rotate, shift, hard drop. They are applied to the local game as
+// they are generated, so the next piece starts from the right board.
+static void planBotKeys(Client &c, const BotConfig &config)
+{
+    GameState &g = *c.game;
+    if (g.over)
+        g = GameState(c.rng.next());
+    const uint8_t queue[2] = {(uint8_t)g.current.piece, (uint8_t)g.next};
+    const SearchResult move = chooseMove(g.board, queue, 2, g.bag.remainingMask(), config);
+    if (move.found)
+    {
+        static const char *ROTATIONS[4] = {"", "w", "ww", "e"};
+        for (const char *k = ROTATIONS[move.best.rot]; *k != '\0'; ++k)
+        {
+            g.apply(*k == 'w' ? Input::RotateCW : Input::RotateCCW);
+            c.keys += *k;
+        }
+        for (int dx = move.best.x - g.current.x; dx != 0; dx += dx < 0 ? 1 : -1)
+        {
+            g.apply(dx < 0 ? Input::Left : Input::Right);
+            c.keys += dx < 0 ? 'a' : 'd';
+        }
+    }
+    g.apply(Input::HardDrop);
+    c.keys += ' ';
+}
+
+static char nextKey(Client &c, InputMode mode, const BotConfig &config)
+{
+    switch (mode)
+    {
+    case InputMode::Random:
+        return "adswe "[c.rng.below(6)];
+    case InputMode::Bot:
+    {
+        if (c.keys.empty())
+            planBotKeys(c, config);
+        const char k = c.keys.front();
+        c.keys.erase(c.keys.begin());
+        return k;
+    }
+    case InputMode::Replay:
+        return replayKeys[c.replayPos++ % replayKeys.size()];
+    }
+    return ' ';
+}
+
+static int connectTo(const std::string &unixPath, const std::string &host, int port)
+{
+    if (!unixPath.empty())
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, unixPath.c_str(), sizeof(addr.sun_path) - 1);
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+// A probe's hard drop goes out with a ctrl-l, which makes the server
+// repaint the whole screen; only that repaint starts with a clear screen.
+constexpr char PROBE_KEYS[2] = {' ', 12};
+constexpr char PROBE_REPLY[] = "\x1b[2J";
+
+// True once the bytes so far have completed PROBE_REPLY.
+static bool matchProbeReply(Client &c, const char *data, size_t length)
+{
+    const size_t replyLength = sizeof(PROBE_REPLY) - 1;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (data[i] == PROBE_REPLY[c.replyMatched])
+            ++c.replyMatched;
+        else
+            c.replyMatched = data[i] == PROBE_REPLY[0] ? 1 : 0;
+        if (c.replyMatched == replyLength)
+        {
+            c.replyMatched = 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drives clients[begin, end) for one step: sends keys on schedule and
+// reads frames until the step ends.
+static void runStep(std::vector<Client> &clients, size_t begin, size_t end, double rate, Clock::time_point start,
+                    Clock::time_point stop, InputMode mode, const BotConfig &config, StepStats &stats)
+{
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    TimerWheel wheel(0);
+    auto tickAt = [&](Clock::time_point t)
+    {
+        return t <= start ? 0 : (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(t - start).count();
+    };
+    auto schedule = [&](Client &c)
+    {
+        // Round up so a key never goes out before it is due.
+        const auto offset = std::chrono::duration_cast<std::chrono::microseconds>(c.due - start).count();
+        wheel.schedule(c.timer, (uint64_t)(offset + 999) / 1000);
+    };
+
+    for (size_t i = begin; i < end; ++i)
+    {
+        Client &c = clients[i];
+        c.timer.owner = &c;
+        c.probing = false;
+        c.replyMatched = 0;
+        c.period = 1.0 / rate;
+        // Spread the first keys over one period so sessions don't fire in lockstep.
+        c.due = start + std::chrono::microseconds((int64_t)(c.rng.next() % 1000000 * c.period));
+        schedule(c);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &c;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev);
+    }
+
+    // Frames from before the step don't count.
+    char buffer[65536];
+    for (size_t i = begin; i < end; ++i)
+    {
+        while (recv(clients[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+        {
+        }
+    }
+
+    epoll_event events[512];
+    for (;;)
+    {
+        const Clock::time_point now = Clock::now();
+        if (now >= stop)
+            break;
+        wheel.advance(tickAt(now), [&](TimerNode &t)
+        {
+            Client &c = *(Client *)t.owner;
+            const char key = nextKey(c, mode, config);
+            const bool probe = key == ' ' && !c.probing;
+            const size_t length = probe ? sizeof(PROBE_KEYS) : 1;
+            if (send(c.fd, probe ? PROBE_KEYS : &key, length, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)length)
+            {
+                ++stats.sent;
+                if (now - c.due > std::chrono::duration<double>(c.period))
+                    ++stats.late;
+                if (probe)
+                {
+                    c.probing = true;
+                    c.probeDue = c.due;
+                    c.replyMatched = 0;
+                }
+            }
+            c.due += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(c.period));
+            schedule(c);
+        });
+
+        const uint64_t wake = wheel.nextWake();
+        int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(stop - now).count() + 1;
+        if (wake != 0)
+            timeout = std::min(timeout, (int)std::max<int64_t>(0, (int64_t)wake - (int64_t)tickAt(now)));
+        const int n = epoll_wait(epfd, events, 512, timeout);
+        const Clock::time_point arrived = Clock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            Client &c = *(Client *)events[i].data.ptr;
+            ssize_t got;
+            while ((got = recv(c.fd, buffer, sizeof(buffer), MSG_DONTWAIT)) > 0)
+            {
+                stats.received += (uint64_t)got;
+                if (c.probing && matchProbeReply(c, buffer, (size_t)got))
+                {
+                    const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(arrived - c.probeDue);
+                    stats.latency.record((uint64_t)std::max<int64_t>(0, latency.count()));
+                    c.probing = false;
+                }
+            }
+            if (got == 0)
+            {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, nullptr);
+                wheel.cancel(c.timer);
+            }
+        }
+    }
+    for (size_t i = begin; i < end; ++i)
+        wheel.cancel(clients[i].timer);
+    close(epfd);
+}
+
+int main(int argc, char **argv)
+{
+    std::string host = "127.0.0.1";
+    int port = 7000;
+    std::string unixPath;
+    int sessions = 100;
+    int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<double> rates = {5};
+    double duration = 10;
+    double sloMs = 50;
+    uint64_t seed = 1;
+    InputMode mode = InputMode::Random;
+    BotConfig config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--host") && hasValue)
+            host = argv[++i];
+        else if (!std::strcmp(arg, "--port") && hasValue)
+            port = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--unix") && hasValue)
+            unixPath = argv[++i];
+        else if (!std::strcmp(arg, "--sessions") && hasValue)
+            sessions = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--threads") && hasValue)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--rate") && hasValue)
+        {
+            rates.clear();
+            for (const char *p = argv[++i]; *p != '\0';)
+            {
+                char *endp;
+                rates.push_back(std::strtod(p, &endp));
+                p = *endp == ',' ? endp + 1 : endp;
+                if (endp == p && *p != '\0')
+                    break;
+            }
+        }
+        else if (!std::strcmp(arg, "--duration") && hasValue)
+            duration = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--slo-ms") && hasValue)
+            sloMs = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--seed") && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--input") && hasValue)
+        {
+            const std::string input = argv[++i];
+            if (input == "random")
+                mode = InputMode::Random;
+            else if (input == "bot")
+                mode = InputMode::Bot;
+            else
+            {
+                std::ifstream file(input, std::ios::binary);
+                replayKeys.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                if (replayKeys.empty())
+                {
+                    std::fprintf(stderr, "cannot read keys from %s\n", input.c_str());
+                    return 1;
+                }
+                mode = InputMode::Replay;
+            }
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    sessions = std::max(1, sessions);
+    threads = std::max(1, std::min(threads, sessions));
+    rates.erase(std::remove_if(rates.begin(), rates.end(), [](double r) { return !(r > 0); }), rates.end());
+    if (rates.empty())
+    {
+        usage();
+        return 2;
+    }
+
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::vector<Client> clients(sessions);
+    Rng seeds(seed);
+    for (int i = 0; i < sessions; ++i)
+    {
+        Client &c = clients[i];
+        c.fd = connectTo(unixPath, host, port);
+        if (c.fd < 0)
+        {
+            std::fprintf(stderr, "connection %d failed: %s\n", i, std::strerror(errno));
+            return 1;
+        }
+        c.rng = Rng(seeds.next());
+        if (mode == InputMode::Bot)
+            c.game.reset(new GameState(c.rng.next()));
+        c.replayPos = replayKeys.empty() ? 0 : c.rng.next() % replayKeys.size();
+    }
+    std::printf("%d sessions connected, %d threads, %s input\n", sessions, threads,
+                mode == InputMode::Random ? "random" : mode == InputMode::Bot ? "bot" : "replayed");
+
+    bool saturated = false;
+    for (double rate : rates)
+    {
+        std::vector<StepStats> stats(threads);
+        std::vector<std::thread> workers;
+        const Clock::time_point start = Clock::now() + std::chrono::milliseconds(50);
+        const Clock::time_point stop = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(duration));
+        for (int t = 0; t < threads; ++t)
+        {
+            const size_t begin = (size_t)sessions * t / threads;
+            const size_t end = (size_t)sessions * (t + 1) / threads;
+            workers.emplace_back([&, t, begin, end]()
+            {
+                runStep(clients, begin, end, rate, start, stop, mode, config, stats[t]);
+            });
+        }
+        for (auto &w : workers)
+            w.join();
+
+        StepStats total;
+        for (StepStats &s : stats)
+        {
+            total.sent += s.sent;
+            total.received += s.received;
+            total.late += s.late;
+            total.latency.merge(s.latency, false);
+        }
+        const double offered = rate * sessions;
+        const double achieved = total.sent / duration;
+        const double p99 = total.latency.percentile(0.99) / 1000.0;
+        std::printf("rate %g/s per session (%.0f/s offered): sent %.0f/s, %.1f%% late\n", rate, offered, achieved,
+                    total.sent ? 100.0 * total.late / total.sent : 0.0);
+        std::printf("  input-to-frame over %llu probes: p50 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, max %.2f ms\n",
+                    (unsigned long long)total.latency.count(), total.latency.percentile(0.5) / 1000.0, p99,
+                    total.latency.percentile(0.999) / 1000.0, total.latency.percentile(1) / 1000.0);
+        std::printf("  %.2f KB/s per session, %.2f MB/s total\n", total.received / 1024.0 / duration / sessions,
+                    total.received / (1024.0 * 1024.0) / duration);
+        if (!saturated && (p99 > sloMs || achieved < 0.95 * offered))
+        {
+            saturated = true;
+            std::printf("  saturated: %s\n", p99 > sloMs ? "p99 latency above --slo-ms" : "fell behind the offered rate");
+        }
+    }
+    if (!saturated)
+        std::printf("no saturation up to %g keys/s per session\n", rates.back());
+
+    for (Client &c : clients)
+        close(c.fd);
+    return 0;
+}
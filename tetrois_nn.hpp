@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TETROIS_NN_X86 1
+#endif
+
+#include "tetrois_bot.hpp"
+#include "tetrois_engine.hpp"
+
+// Optional neural evaluator: a two-layer MLP over the board features with
+// integer weights, evaluated in fixed point so every kernel (scalar, SSE4.1,
+// AVX2) returns bit-identical scores. The SIMD kernels are compiled with
+// target attributes and picked at run time, so a plain -O2 build gets them.
+//
+//   inputs  int16[INPUTS]: the seven heuristic features, then column heights
+//   hidden  clamp((b1 + W1 x) >> W1_SHIFT, 0, HIDDEN_CLIP)
+//   output  (b2 + W2 h) / OUTPUT_SCALE
+//
+// W1 is stored as input pairs interleaved per hidden unit, the layout
+// pmaddwd wants: one broadcast pair of inputs updates eight hidden sums.
+//
+// Weight file (little endian): "TNN1", uint32 INPUTS, uint32 HIDDEN, then
+// int16 W1[HIDDEN][INPUTS], int32 b1[HIDDEN], int16 W2[HIDDEN], int32 b2.
+class NnEvaluator
+{
+public:
+    static constexpr int INPUTS = 32;
+    static constexpr int HIDDEN = 32;
+    static constexpr int W1_SHIFT = 6;
+    static constexpr int HIDDEN_CLIP = 1023;
+    static constexpr double OUTPUT_SCALE = 4096.0;
+    static constexpr int FEATURE_INPUTS = WEIGHT_COUNT + GRID_COLS;
+    static_assert(FEATURE_INPUTS <= INPUTS && INPUTS % 2 == 0, "inputs are consumed in pairs");
+
+    enum Kernel
+    {
+        KERNEL_SCALAR,
+        KERNEL_SSE41,
+        KERNEL_AVX2,
+    };
+
+    NnEvaluator() : w1{}, b1{}, w2{}, b2(0), active(bestKernel()) {}
+
+    static Kernel bestKernel()
+    {
+#ifdef TETROIS_NN_X86
+        if (__builtin_cpu_supports("avx2"))
+            return KERNEL_AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return KERNEL_SSE41;
+#endif
+        return KERNEL_SCALAR;
+    }
+
+    static const char *kernelName(Kernel k)
+    {
+        return k == KERNEL_AVX2 ? "avx2" : k == KERNEL_SSE41 ? "sse4.1" : "scalar";
+    }
+
+    Kernel kernel() const { return active; }
+
+    // Falls back to the best supported kernel if k is not available.
+    void setKernel(Kernel k) { active = std::min(k, bestKernel()); }
+
+    // A network that reproduces the linear heuristic: hidden unit i passes
+    // feature i through unchanged and the output layer applies the weights.
+    static NnEvaluator fromHeuristic(const EvalWeights &w)
+    {
+        NnEvaluator nn;
+        for (int i = 0; i < WEIGHT_COUNT; ++i)
+        {
+            nn.setW1(i, i, 1 << W1_SHIFT);
+            nn.w2[i] = quantizeOutput(w.*WEIGHT_FIELDS[i]);
+        }
+        return nn;
+    }
+
+    static void encode(const BoardFeatures &f, int16_t *in)
+    {
+        const int values[WEIGHT_COUNT] = {f.aggregateHeight, f.holes,          f.bumpiness,   f.wells,
+                                          f.rowTransitions,  f.colTransitions, f.linesCleared};
+        std::fill(in, in + INPUTS, (int16_t)0);
+        for (int i = 0; i < WEIGHT_COUNT; ++i)
+            in[i] = (int16_t)values[i];
+        for (int x = 0; x < GRID_COLS; ++x)
+            in[WEIGHT_COUNT + x] = (int16_t)f.heights[x];
+    }
+
+    bool load(const char *path)
+    {
+        FILE *f = std::fopen(path, "rb");
+        if (f == nullptr)
+            return false;
+        char magic[4];
+        uint32_t dims[2];
+        int16_t rows[HIDDEN][INPUTS];
+        NnEvaluator nn;
+        bool ok = std::fread(magic, 1, 4, f) == 4 && std::memcmp(magic, "TNN1", 4) == 0 &&
+                  std::fread(dims, sizeof(dims), 1, f) == 1 && dims[0] == INPUTS && dims[1] == HIDDEN &&
+                  std::fread(rows, sizeof(rows), 1, f) == 1 && std::fread(nn.b1, sizeof(nn.b1), 1, f) == 1 &&
+                  std::fread(nn.w2, sizeof(nn.w2), 1, f) == 1 && std::fread(&nn.b2, sizeof(nn.b2), 1, f) == 1;
+        std::fclose(f);
+        if (!ok)
+            return false;
+        for (int j = 0; j < HIDDEN; ++j)
+        {
+            for (int i = 0; i < INPUTS; ++i)
+                nn.setW1(j, i, rows[j][i]);
+        }
+        nn.active = active;
+        *this = nn;
+        return true;
+    }
+
+    bool save(const char *path) const
+    {
+        FILE *f = std::fopen(path, "wb");
+        if (f == nullptr)
+            return false;
+        const uint32_t dims[2] = {INPUTS, HIDDEN};
+        int16_t rows[HIDDEN][INPUTS];
+        for (int j = 0; j < HIDDEN; ++j)
+        {
+            for (int i = 0; i < INPUTS; ++i)
+                rows[j][i] = w1[i / 2][j][i % 2];
+        }
+        bool ok = std::fwrite("TNN1", 1, 4, f) == 4 && std::fwrite(dims, sizeof(dims), 1, f) == 1 &&
+                  std::fwrite(rows, sizeof(rows), 1, f) == 1 && std::fwrite(b1, sizeof(b1), 1, f) == 1 &&
+                  std::fwrite(w2, sizeof(w2), 1, f) == 1 && std::fwrite(&b2, sizeof(b2), 1, f) == 1;
+        return std::fclose(f) == 0 && ok;
+    }
+
+    // inputs holds count rows of INPUTS values.
+    void evaluateBatch(const int16_t *inputs, int count, double *out) const
+    {
+        for (int n = 0; n < count; ++n)
+        {
+            const int16_t *x = inputs + (size_t)n * INPUTS;
+            int32_t raw;
+#ifdef TETROIS_NN_X86
+            if (active == KERNEL_AVX2)
+                raw = forwardAvx2(x);
+            else if (active == KERNEL_SSE41)
+                raw = forwardSse41(x);
+            else
+#endif
+                raw = forwardScalar(x);
+            out[n] = raw / OUTPUT_SCALE;
+        }
+    }
+
+    double evaluate(const BoardFeatures &f) const
+    {
+        alignas(32) int16_t in[INPUTS];
+        encode(f, in);
+        double out;
+        evaluateBatch(in, 1, &out);
+        return out;
+    }
+
+    // Scores every candidate placement of one piece with a single batched call.
+    void evaluatePlacements(const Board &board, const PlacementList &candidates, double *scores) const
+    {
+        alignas(32) int16_t inputs[MAX_PLACEMENTS][INPUTS];
+        for (int i = 0; i < candidates.size(); ++i)
+        {
+            Board next = board;
+            next.place(candidates[i]);
+            const int cleared = next.clearLines();
+            encode(computeFeatures(next, cleared), inputs[i]);
+        }
+        evaluateBatch(&inputs[0][0], candidates.size(), scores);
+    }
+
+    // Same contract as the heuristic pickPlacement().
+    int pickPlacement(const Board &board, int piece, Placement &best) const
+    {
+        PlacementList candidates;
+        double scores[MAX_PLACEMENTS];
+        if (!generatePlacements(board, piece, candidates) || candidates.empty())
+            return 0;
+        evaluatePlacements(board, candidates, scores);
+        best = candidates[(int)(std::max_element(scores, scores + candidates.size()) - scores)];
+        return candidates.size();
+    }
+
+private:
+    alignas(32) int16_t w1[INPUTS / 2][HIDDEN][2];
+    alignas(32) int32_t b1[HIDDEN];
+    alignas(32) int16_t w2[HIDDEN];
+    int32_t b2;
+    Kernel active;
+
+    void setW1(int hidden, int input, int16_t value) { w1[input / 2][hidden][input % 2] = value; }
+
+    static int16_t quantizeOutput(double w)
+    {
+        return (int16_t)std::max(-32767.0, std::min(32767.0, std::round(w * OUTPUT_SCALE)));
+    }
+
+    int32_t forwardScalar(const int16_t *x) const
+    {
+        int32_t acc[HIDDEN];
+        std::copy(b1, b1 + HIDDEN, acc);
+        for (int p = 0; p < INPUTS / 2; ++p)
+        {
+            if ((x[2 * p] | x[2 * p + 1]) == 0)
+                continue;
+            for (int j = 0; j < HIDDEN; ++j)
+                acc[j] += w1[p][j][0] * x[2 * p] + w1[p][j][1] * x[2 * p + 1];
+        }
+        int32_t out = b2;
+        for (int j = 0; j < HIDDEN; ++j)
+            out += w2[j] * std::max(0, std::min(HIDDEN_CLIP, acc[j] >> W1_SHIFT));
+        return out;
+    }
+
+#ifdef TETROIS_NN_X86
+    __attribute__((target("sse4.1"))) int32_t forwardSse41(const int16_t *x) const
+    {
+        constexpr int LANES = 4;
+        __m128i acc[HIDDEN / LANES];
+        for (int k = 0; k < HIDDEN / LANES; ++k)
+            acc[k] = _mm_load_si128((const __m128i *)(b1 + LANES * k));
+        for (int p = 0; p < INPUTS / 2; ++p)
+        {
+            uint32_t pair;
+            std::memcpy(&pair, x + 2 * p, sizeof(pair));
+            if (pair == 0)
+                continue;
+            const __m128i xv = _mm_set1_epi32((int)pair);
+            const __m128i *w = (const __m128i *)w1[p];
+            for (int k = 0; k < HIDDEN / LANES; ++k)
+                acc[k] = _mm_add_epi32(acc[k], _mm_madd_epi16(_mm_load_si128(w + k), xv));
+        }
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i clip = _mm_set1_epi32(HIDDEN_CLIP);
+        __m128i sum = zero;
+        for (int k = 0; k < HIDDEN / LANES; ++k)
+        {
+            const __m128i h = _mm_min_epi32(_mm_max_epi32(_mm_srai_epi32(acc[k], W1_SHIFT), zero), clip);
+            const __m128i w = _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)(w2 + LANES * k)));
+            sum = _mm_add_epi32(sum, _mm_mullo_epi32(h, w));
+        }
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        return b2 + _mm_cvtsi128_si32(sum);
+    }
+
+    __attribute__((target("avx2"))) int32_t forwardAvx2(const int16_t *x) const
+    {
+        constexpr int LANES = 8;
+        __m256i acc[HIDDEN / LANES];
+        for (int k = 0; k < HIDDEN / LANES; ++k)
+            acc[k] = _mm256_load_si256((const __m256i *)(b1 + LANES * k));
+        for (int p = 0; p < INPUTS / 2; ++p)
+        {
+            uint32_t pair;
+            std::memcpy(&pair, x + 2 * p, sizeof(pair));
+            if (pair == 0)
+                continue;
+            const __m256i xv = _mm256_set1_epi32((int)pair);
+            const __m256i *w = (const __m256i *)w1[p];
+            for (int k = 0; k < HIDDEN / LANES; ++k)
+                acc[k] = _mm256_add_epi32(acc[k], _mm256_madd_epi16(_mm256_load_si256(w + k), xv));
+        }
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i clip = _mm256_set1_epi32(HIDDEN_CLIP);
+        __m256i sum = zero;
+        for (int k = 0; k < HIDDEN / LANES; ++k)
+        {
+            const __m256i h = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(acc[k], W1_SHIFT), zero), clip);
+            const __m256i w = _mm256_cvtepi16_epi32(_mm_load_si128((const __m128i *)(w2 + LANES * k)));
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(h, w));
+        }
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+        return b2 + _mm_cvtsi128_si32(s);
+    }
+#endif
+};
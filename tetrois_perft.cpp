@@ -0,0 +1,143 @@
+// Perft for the placement engine: counts the distinct placement sequences of
+// a piece queue to a given depth. The counts are a correctness oracle for
+// generatePlacements() and the timings are our placement-engine benchmark.
+//
+//   g++ -std=c++17 -O2 -pthread tetrois_perft.cpp -o tetrois-perft
+//   ./tetrois-perft --depth 3 --seed 1
+//   ./tetrois-perft --depth 3 --queue TSZ --expect 123456
+//   ./tetrois-perft --depth 4 --scaling
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tetrois_engine.hpp"
+#include "tetrois_search.hpp"
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: tetrois-perft [--depth N] [--seed S] [--queue PIECES] [--threads T] [--expect COUNT] [--scaling]\n"
+                 "  PIECES is a string over %s; without it the queue is drawn from a 7-bag seeded with S\n"
+                 "  --scaling runs the parallel count on 1, 2, 4, 8, 16 and 32 threads\n",
+                 PIECE_NAMES);
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    int depth = 3;
+    uint64_t seed = 1;
+    std::string queueArg;
+    int threads = (int)std::thread::hardware_concurrency();
+    long long expect = -1;
+    bool scaling = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--depth") && hasValue)
+            depth = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--seed") && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--queue") && hasValue)
+            queueArg = argv[++i];
+        else if (!std::strcmp(arg, "--threads") && hasValue)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--expect") && hasValue)
+            expect = std::atoll(argv[++i]);
+        else if (!std::strcmp(arg, "--scaling"))
+            scaling = true;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (threads < 1)
+        threads = 1;
+
+    std::vector<uint8_t> queue;
+    if (!queueArg.empty())
+    {
+        for (char c : queueArg)
+        {
+            const int piece = pieceFromName(c);
+            if (piece < 0)
+            {
+                std::fprintf(stderr, "unknown piece '%c'\n", c);
+                return 2;
+            }
+            queue.push_back((uint8_t)piece);
+        }
+        if ((int)queue.size() < depth)
+            depth = (int)queue.size();
+    }
+    else
+    {
+        Bag bag(seed);
+        for (int i = 0; i < depth; ++i)
+            queue.push_back((uint8_t)bag.next());
+    }
+    if (depth < 1)
+    {
+        usage();
+        return 2;
+    }
+
+    std::string names;
+    for (uint8_t p : queue)
+        names += PIECE_NAMES[p];
+    std::printf("queue %s\n", names.c_str());
+    std::printf("%-6s %16s %10s %14s\n", "depth", "sequences", "seconds", "nps");
+
+    const Board empty;
+    uint64_t serial = 0;
+    for (int d = 1; d <= depth; ++d)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        serial = perft(empty, queue.data(), d);
+        const double secs = secondsSince(start);
+        std::printf("%-6d %16llu %10.3f %14.0f\n", d, (unsigned long long)serial, secs, secs > 0 ? serial / secs : 0.0);
+    }
+
+    std::vector<int> threadCounts = {threads};
+    if (scaling)
+        threadCounts = {1, 2, 4, 8, 16, 32};
+
+    double baseSecs = 0;
+    for (int t : threadCounts)
+    {
+        WorkStealingPool pool(t);
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t parallel = perftParallel(empty, queue.data(), depth, pool);
+        const double secs = secondsSince(start);
+        if (t == threadCounts.front())
+            baseSecs = secs * t;
+        std::printf("parallel (%d threads) depth %d: %llu sequences, %.3f s, %.0f nps, efficiency %.0f%%\n",
+                    t, depth, (unsigned long long)parallel, secs, secs > 0 ? parallel / secs : 0.0,
+                    secs > 0 ? 100.0 * baseSecs / (secs * t) : 0.0);
+
+        if (parallel != serial)
+        {
+            std::fprintf(stderr, "mismatch: serial %llu, parallel %llu\n",
+                         (unsigned long long)serial, (unsigned long long)parallel);
+            return 1;
+        }
+    }
+    if (expect >= 0 && (uint64_t)expect != serial)
+    {
+        std::fprintf(stderr, "mismatch: expected %lld, got %llu\n", expect, (unsigned long long)serial);
+        return 1;
+    }
+    return 0;
+}
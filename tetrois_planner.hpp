@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include "tetrois_engine.hpp"
+#include "tetrois_search.hpp"
+
+// Anytime bot for live play: a background thread searches the current piece
+// while it falls, starting with the greedy move and then repeating the
+// configured search with more and more effort. Every completed iteration is
+// published through one atomic slot, so the game reads the best move so far
+// at any moment without waiting, and commits it when its deadline arrives.
+class AsyncPlanner
+{
+public:
+    static constexpr int MAX_QUEUE = 8;
+    static constexpr int MAX_BEAM_WIDTH = 4096;
+    static constexpr int MAX_EXPAND = 64;
+    static constexpr double MIN_PROBABILITY_FLOOR = 1e-4;
+
+    // config is the first non-greedy iteration; later ones widen the beam, or
+    // deepen and then widen the expectimax. Its time budget is ignored: the
+    // caller decides when to stop.
+    explicit AsyncPlanner(const BotConfig &config) : base(config), thread([this]() { threadLoop(); }) {}
+
+    ~AsyncPlanner()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            cancelFlag.store(true, std::memory_order_relaxed);
+        }
+        wakeup.notify_one();
+        thread.join();
+    }
+
+    AsyncPlanner(const AsyncPlanner &) = delete;
+    AsyncPlanner &operator=(const AsyncPlanner &) = delete;
+
+    // Abandons any running search and starts on a new position. Only the
+    // first MAX_QUEUE pieces of the queue are used.
+    void start(const Board &board, const uint8_t *queue, int queueLen, uint32_t bagMask)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job.board = board;
+            job.queueLen = std::min(queueLen, MAX_QUEUE);
+            std::copy(queue, queue + job.queueLen, job.queue);
+            job.bagMask = bagMask;
+            job.ticket = (ticket + 1) & TICKET_MASK;
+            ticket = job.ticket;
+            pending = true;
+            cancelFlag.store(true, std::memory_order_relaxed);
+            done.store(false, std::memory_order_relaxed);
+        }
+        wakeup.notify_one();
+    }
+
+    // Stops the search; the best move found so far stays readable.
+    void cancel() { cancelFlag.store(true, std::memory_order_relaxed); }
+
+    // Best placement found so far for the position of the last start().
+    // Never blocks. depth, if given, receives the depth of that search.
+    bool best(Placement &out, int *depth = nullptr) const
+    {
+        const uint64_t slot = published.load(std::memory_order_acquire);
+        if (slot == 0 || (uint32_t)(slot >> 40) != ticket)
+            return false;
+        const uint32_t move = (uint32_t)slot;
+        std::memcpy(&out, &move, sizeof(out));
+        if (depth)
+            *depth = (int)((slot >> 32) & 0xFF);
+        return true;
+    }
+
+    // True once every iteration has run, so waiting longer gains nothing.
+    bool finished() const { return done.load(std::memory_order_acquire); }
+
+private:
+    static constexpr uint32_t TICKET_MASK = 0xFFFFFF;
+
+    struct Job
+    {
+        Board board;
+        uint8_t queue[MAX_QUEUE];
+        int queueLen = 0;
+        uint32_t bagMask = 0;
+        uint32_t ticket = 0;
+    };
+
+    const BotConfig base;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    Job job;
+    bool pending = false;
+    bool stopping = false;
+    uint32_t ticket = 0; // written by start() only, read on the game thread
+    std::atomic<bool> cancelFlag{false};
+    std::atomic<bool> done{false};
+    // ticket (24) | depth (8) | placement (32), 0 when empty
+    std::atomic<uint64_t> published{0};
+    std::thread thread;
+
+    static_assert(sizeof(Placement) == sizeof(uint32_t), "placement must fit the slot");
+
+    void publish(uint32_t jobTicket, const SearchResult &result)
+    {
+        uint32_t move;
+        std::memcpy(&move, &result.best, sizeof(move));
+        const uint64_t depth = (uint64_t)std::min(std::max(result.depth, 0), 255);
+        published.store((uint64_t)jobTicket << 40 | depth << 32 | move, std::memory_order_release);
+    }
+
+    // Settings for iteration n (0 = greedy); false once there are no more.
+    bool iteration(int n, BotConfig &config) const
+    {
+        config = base;
+        config.timeBudgetMs = 0;
+        config.stop = &cancelFlag;
+        if (n == 0)
+        {
+            config.beamWidth = 0;
+            config.expectimaxDepth = 0;
+            return true;
+        }
+        if (base.expectimaxDepth > 0)
+        {
+            if (n <= base.expectimaxDepth)
+            {
+                config.expectimaxDepth = n;
+                return true;
+            }
+            for (int widen = base.expectimaxDepth; widen < n; ++widen)
+            {
+                config.expandTop = std::min(MAX_EXPAND, config.expandTop * 2);
+                config.minProbability /= 2;
+            }
+            return config.minProbability >= MIN_PROBABILITY_FLOOR || config.expandTop < MAX_EXPAND;
+        }
+        if (base.beamWidth > 0)
+        {
+            int width = base.beamWidth;
+            for (int k = 1; k < n; ++k)
+            {
+                if (width >= MAX_BEAM_WIDTH)
+                    return false;
+                width = std::min(MAX_BEAM_WIDTH, width * 2);
+            }
+            config.beamWidth = width;
+            return true;
+        }
+        return false;
+    }
+
+    void threadLoop()
+    {
+        while (true)
+        {
+            Job current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeup.wait(lock, [this]() { return pending || stopping; });
+                if (stopping)
+                    return;
+                current = job;
+                pending = false;
+                cancelFlag.store(false, std::memory_order_relaxed);
+            }
+
+            BotConfig config;
+            for (int n = 0; iteration(n, config); ++n)
+            {
+                const SearchResult result = chooseMove(current.board, current.queue, current.queueLen,
+                                                       current.bagMask, config);
+                if (stopRequested(config))
+                    break;
+                if (!result.found)
+                    break; // tops out: no deeper search will find a move either
+                publish(current.ticket, result);
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!pending)
+                done.store(true, std::memory_order_release);
+        }
+    }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool for the searches. Every thread owns a deque: it
+// pushes and pops its own tasks at the back (depth first, cache friendly)
+// while idle threads steal from the front of other deques, where the larger
+// subtrees sit. A thread waiting on a TaskGroup runs tasks instead of
+// blocking, so tasks may spawn and wait on subtasks freely.
+class WorkStealingPool
+{
+public:
+    struct TaskGroup
+    {
+        std::atomic<int> pending{0};
+    };
+
+    // threads counts the calling thread, which helps out in wait().
+    explicit WorkStealingPool(int threads) : queues(threads < 1 ? 1 : threads)
+    {
+        for (auto &q : queues)
+            q.reset(new Queue());
+        // If a thread fails to start, the ones already running are stopped
+        // before the error leaves, so no joinable thread is destroyed.
+        try
+        {
+            for (int i = 1; i < (int)queues.size(); ++i)
+                workers.emplace_back([this, i]() { workerLoop(i); });
+        }
+        catch (...)
+        {
+            stop();
+            throw;
+        }
+    }
+
+    ~WorkStealingPool() { stop(); }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    int threadCount() const { return (int)queues.size(); }
+
+    // True when some worker has nothing to do, i.e. splitting a subtree now
+    // would actually be picked up.
+    bool hasIdleWorkers() const { return idle.load(std::memory_order_relaxed) > 0; }
+
+    void spawn(TaskGroup &group, std::function<void()> fn)
+    {
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        Queue &q = *queues[selfIndex()];
+        {
+            std::lock_guard<std::mutex> lock(q.mutex);
+            q.jobs.push_back(Job{std::move(fn), &group});
+        }
+        if (idle.load(std::memory_order_relaxed) > 0)
+            sleepCv.notify_one();
+    }
+
+    void wait(TaskGroup &group)
+    {
+        const int self = selfIndex();
+        while (group.pending.load(std::memory_order_acquire) > 0)
+        {
+            Job job;
+            if (takeJob(self, job))
+                run(job);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        sleepCv.notify_all();
+        for (auto &w : workers)
+            w.join();
+    }
+
+    struct Job
+    {
+        std::function<void()> fn;
+        TaskGroup *group = nullptr;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> idle{0};
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+    bool stopping = false;
+
+    static WorkStealingPool *&currentPool()
+    {
+        static thread_local WorkStealingPool *pool = nullptr;
+        return pool;
+    }
+
+    static int &currentIndex()
+    {
+        static thread_local int index = 0;
+        return index;
+    }
+
+    // Threads outside the pool share queue 0 with the caller.
+    int selfIndex() const { return currentPool() == this ? currentIndex() : 0; }
+
+    bool takeJob(int self, Job &job)
+    {
+        {
+            Queue &own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+        const int n = (int)queues.size();
+        for (int k = 1; k < n; ++k)
+        {
+            Queue &victim = *queues[(self + k) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void run(Job &job)
+    {
+        job.fn();
+        job.group->pending.fetch_sub(1, std::memory_order_release);
+    }
+
+    void workerLoop(int index)
+    {
+        currentPool() = this;
+        currentIndex() = index;
+        while (true)
+        {
+            Job job;
+            if (takeJob(index, job))
+            {
+                run(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            if (stopping)
+                return;
+            idle.fetch_add(1, std::memory_order_relaxed);
+            sleepCv.wait_for(lock, std::chrono::milliseconds(1));
+            idle.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+};
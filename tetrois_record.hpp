@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+#include "tetrois_engine.hpp"
+
+// Self-play training data as written by tetrois-export. A shard file is one
+// ShardHeader followed by header.records TrainingRecords, all 64 bytes and
+// little endian, so a trainer can mmap the file and index records directly
+// (numpy: np.memmap(path, dtype=record_dtype, offset=64)).
+
+constexpr char SHARD_MAGIC[4] = {'T', 'T', 'R', 'D'};
+constexpr uint32_t SHARD_VERSION = 1;
+constexpr int RECORD_QUEUE = 6; // current piece plus five preview pieces
+
+struct ShardHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t shard;
+    uint64_t records; // filled in when the shard is closed
+    uint64_t seed;
+    uint8_t reserved[32];
+};
+
+// One decision: the position the bot saw, the placement it chose and how
+// the game went from there.
+struct TrainingRecord
+{
+    uint16_t rows[GRID_ROWS];    // bit x = column x, row 0 = top
+    uint8_t queue[RECORD_QUEUE]; // piece indices into PIECE_NAMES
+    uint8_t bagMask;             // pieces left in the 7-bag after the queue
+    uint8_t linesCleared;        // by this placement
+    int8_t rot;                  // chosen placement, as in Placement
+    int8_t x;
+    int8_t y;
+    uint8_t flags;               // RECORD_TOPPED_OUT
+    uint32_t game;
+    uint16_t move;               // index of the decision within its game
+    uint16_t movesLeft;          // decisions after this one until the game ended
+    uint32_t linesAfter;         // lines cleared from this placement to the end
+};
+
+constexpr uint8_t RECORD_TOPPED_OUT = 1; // the game ended by topping out, not at the piece cap
+
+static_assert(sizeof(ShardHeader) == 64, "shard header is 64 bytes");
+static_assert(sizeof(TrainingRecord) == 64, "records are 64 bytes");
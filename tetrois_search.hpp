@@ -0,0 +1,603 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "tetrois_bot.hpp"
+#include "tetrois_engine.hpp"
+#include "tetrois_nn.hpp"
+#include "tetrois_pool.hpp"
+#include "tetrois_tt.hpp"
+
+// Look-ahead search over the piece queue (current piece plus preview).
+
+// Bump allocator for search nodes and scratch lists: memory is handed out
+// from large blocks that are kept between searches, and released all at once
+// by reset() or rewind(), so a warmed-up search never calls malloc. Objects
+// are never destroyed, hence the trivially destructible restriction.
+class Arena
+{
+    static constexpr size_t BLOCK_SIZE = 1 << 20;
+
+    struct Block
+    {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t blockIdx = 0;
+    size_t used = 0;
+
+    void *allocate(size_t bytes, size_t align)
+    {
+        used = (used + align - 1) & ~(align - 1);
+        if (blocks.empty() || used + bytes > blocks[blockIdx].size)
+        {
+            if (!blocks.empty())
+                ++blockIdx;
+            if (blockIdx == blocks.size() || blocks[blockIdx].size < bytes)
+            {
+                const size_t size = std::max(BLOCK_SIZE, bytes);
+                blocks.insert(blocks.begin() + blockIdx, Block{std::unique_ptr<char[]>(new char[size]), size});
+            }
+            used = 0;
+        }
+        void *p = blocks[blockIdx].data.get() + used;
+        used += bytes;
+        return p;
+    }
+
+public:
+    struct Mark
+    {
+        size_t blockIdx;
+        size_t used;
+    };
+
+    // Default-initialised: fields without initialisers hold garbage.
+    template <typename T>
+    T *makeArray(size_t n)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        static_assert(alignof(T) <= alignof(std::max_align_t), "over-aligned arena object");
+        T *p = static_cast<T *>(allocate(sizeof(T) * n, alignof(T)));
+        for (size_t i = 0; i < n; ++i)
+            new (p + i) T;
+        return p;
+    }
+
+    template <typename T>
+    T *make() { return makeArray<T>(1); }
+
+    Mark mark() const { return Mark{blockIdx, used}; }
+
+    void rewind(const Mark &m)
+    {
+        blockIdx = m.blockIdx;
+        used = m.used;
+    }
+
+    void reset() { rewind(Mark{0, 0}); }
+};
+
+// Each thread searches out of its own arena.
+inline Arena &threadArena()
+{
+    static thread_local Arena arena;
+    return arena;
+}
+
+// Boards already expanded at the current depth, keyed by Zobrist hash.
+// Generation stamps make clearing between depths free.
+class TranspositionTable
+{
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> stamps;
+    uint32_t generation = 1;
+
+public:
+    explicit TranspositionTable(int bits) : keys((size_t)1 << bits), stamps((size_t)1 << bits) {}
+
+    void nextGeneration() { ++generation; }
+
+    // Returns false if the key was already present in this generation.
+    bool insert(uint64_t key)
+    {
+        const size_t mask = keys.size() - 1;
+        for (size_t slot = key & mask, probes = 0; probes < 16; slot = (slot + 1) & mask, ++probes)
+        {
+            if (stamps[slot] != generation)
+            {
+                stamps[slot] = generation;
+                keys[slot] = key;
+                return true;
+            }
+            if (keys[slot] == key)
+                return false;
+        }
+        return true; // table crowded: treat as new rather than dropping the node
+    }
+};
+
+struct BotConfig
+{
+    EvalWeights weights = DEFAULT_WEIGHTS;
+    int beamWidth = 0;    // 0 = greedy one-piece bot
+    int timeBudgetMs = 0; // per piece, 0 = unlimited
+
+    // Expectimax: pieces searched past the visible queue (0 = off), children
+    // expanded per max node and the path probability below which a chance
+    // node is scored statically instead of expanded.
+    int expectimaxDepth = 0;
+    int expandTop = 6;
+    double minProbability = 0.02;
+
+    // Optional: threads to split the search over and a table shared by them.
+    WorkStealingPool *pool = nullptr;
+    SharedTranspositionTable *table = nullptr;
+
+    // Optional: score boards with this network instead of the weighted
+    // features (weights.linesCleared still rewards clears during search).
+    const NnEvaluator *nn = nullptr;
+
+    // Optional: set from another thread to abandon the search. An abandoned
+    // search reports found = false and leaves nothing in the table.
+    const std::atomic<bool> *stop = nullptr;
+};
+
+inline bool stopRequested(const BotConfig &config)
+{
+    return config.stop != nullptr && config.stop->load(std::memory_order_relaxed);
+}
+
+// Static value of a board after line clears have been counted.
+inline double boardValue(const Board &board, const BotConfig &config)
+{
+    const BoardFeatures f = computeFeatures(board, 0);
+    return config.nn != nullptr ? config.nn->evaluate(f) : evaluate(f, config.weights);
+}
+
+struct SearchResult
+{
+    bool found = false;
+    Placement best{};
+    double score = 0;
+    uint64_t nodes = 0;
+    int depth = 0;
+};
+
+struct BeamNode
+{
+    Board board;
+    double lineReward;
+    double score;
+    Placement first;
+};
+
+// Beam search over queue[0..queueLen): every level keeps the beamWidth best
+// boards, scored as line-clear reward so far plus the static evaluation.
+// Each level lives in a fixed array of beamWidth nodes from the arena, kept
+// as a min-heap while children stream in, so memory is O(width) per search.
+// Stops early (returning the deepest completed level) once the time budget
+// is spent; the first level always completes.
+inline SearchResult beamSearch(const Board &root, const uint8_t *queue, int queueLen, const BotConfig &config,
+                               Arena &arena, TranspositionTable &seen)
+{
+    using Clock = std::chrono::steady_clock;
+    const auto deadline = Clock::now() + std::chrono::milliseconds(config.timeBudgetMs);
+    const int width = std::max(1, config.beamWidth);
+    auto worse = [](const BeamNode &a, const BeamNode &b) { return a.score > b.score; };
+
+    SearchResult result;
+    const Arena::Mark mark = arena.mark();
+    BeamNode *beam = arena.makeArray<BeamNode>(width);
+    BeamNode *next = arena.makeArray<BeamNode>(width);
+    PlacementList *placements = arena.make<PlacementList>();
+    int beamCount = 1;
+    beam[0].board = root;
+    beam[0].lineReward = 0;
+    beam[0].score = 0;
+
+    for (int depth = 0; depth < queueLen; ++depth)
+    {
+        int nextCount = 0;
+        seen.nextGeneration();
+        bool timedOut = false;
+        for (int n = 0; n < beamCount; ++n)
+        {
+            if (stopRequested(config))
+            {
+                arena.rewind(mark);
+                return SearchResult{};
+            }
+            if (depth > 0 && config.timeBudgetMs > 0 && Clock::now() >= deadline)
+            {
+                timedOut = true;
+                break;
+            }
+            const BeamNode &node = beam[n];
+            generatePlacements(node.board, queue[depth], *placements);
+            for (const auto &p : *placements)
+            {
+                BeamNode child;
+                child.board = node.board;
+                child.board.place(p);
+                const int cleared = child.board.clearLines();
+                ++result.nodes;
+                if (!seen.insert(zobristHash(child.board)))
+                    continue;
+                child.lineReward = node.lineReward + config.weights.linesCleared * cleared;
+                child.score = child.lineReward + boardValue(child.board, config);
+                child.first = depth == 0 ? p : node.first;
+
+                if (nextCount < width)
+                {
+                    next[nextCount++] = child;
+                    std::push_heap(next, next + nextCount, worse);
+                }
+                else if (child.score > next[0].score)
+                {
+                    std::pop_heap(next, next + width, worse);
+                    next[width - 1] = child;
+                    std::push_heap(next, next + width, worse);
+                }
+            }
+        }
+        if (timedOut || nextCount == 0)
+            break;
+
+        std::swap(beam, next);
+        beamCount = nextCount;
+
+        const BeamNode *best = std::min_element(beam, beam + beamCount, worse);
+        result.found = true;
+        result.best = best->first;
+        result.score = best->score;
+        result.depth = depth + 1;
+    }
+    arena.rewind(mark);
+    return result;
+}
+
+constexpr double TOP_OUT_SCORE = -1e9;
+
+// Bits of the table key that tell apart searches of different breadth, so an
+// entry found with fewer expanded children is not reused by a wider search.
+inline uint64_t searchBreadthKey(const BotConfig &config)
+{
+    const uint64_t prob = (uint64_t)(config.minProbability * 65536) & 0xFFFF;
+    return ((uint64_t)(config.expandTop & 0xFF) << 16) | prob << 24;
+}
+
+struct ExpectimaxSearch
+{
+    const uint8_t *queue;
+    int queueLen;
+    int totalDepth;
+    const BotConfig &config;
+    std::atomic<uint64_t> &nodeTotal;
+    uint64_t nodes = 0;
+
+    // Per-depth lists, carved from the running thread's arena and handed
+    // back when the search ends (searches nest on a thread stack-wise).
+    struct Scratch
+    {
+        PlacementList placements;
+        std::pair<double, int> ranked[MAX_PLACEMENTS];
+    };
+    Arena &arena;
+    Arena::Mark mark;
+    Scratch *scratch;
+
+    ExpectimaxSearch(const uint8_t *queue, int queueLen, const BotConfig &config, std::atomic<uint64_t> &nodeTotal)
+        : queue(queue), queueLen(queueLen), totalDepth(queueLen + config.expectimaxDepth), config(config),
+          nodeTotal(nodeTotal), arena(threadArena()), mark(arena.mark()),
+          scratch(arena.makeArray<Scratch>(totalDepth)) {}
+
+    // Searches started for a stolen subtree share everything but the scratch.
+    ExpectimaxSearch(const ExpectimaxSearch &parent)
+        : ExpectimaxSearch(parent.queue, parent.queueLen, parent.config, parent.nodeTotal) {}
+
+    ~ExpectimaxSearch()
+    {
+        nodeTotal.fetch_add(nodes, std::memory_order_relaxed);
+        arena.rewind(mark);
+    }
+
+    double staticValue(const Board &board) const
+    {
+        return boardValue(board, config);
+    }
+
+    // Whether the subtree below depth is worth handing to another thread:
+    // the root always splits, deeper levels only while workers sit idle.
+    bool shouldSplit(int depth) const
+    {
+        if (config.pool == nullptr || totalDepth - depth < 2)
+            return false;
+        return depth == 0 || config.pool->hasIdleWorkers();
+    }
+
+    // Best value over placements of piece on board (depth pieces already placed).
+    double maxNode(const Board &board, int piece, int depth, uint32_t bagMask, double pathProb, Placement *bestOut)
+    {
+        Scratch &s = scratch[depth];
+        if (stopRequested(config))
+            return TOP_OUT_SCORE;
+        if (!generatePlacements(board, piece, s.placements) || s.placements.empty())
+            return TOP_OUT_SCORE;
+
+        const int count = s.placements.size();
+        for (int i = 0; i < count; ++i)
+        {
+            Board child = board;
+            child.place(s.placements[i]);
+            const int cleared = child.clearLines();
+            s.ranked[i] = std::make_pair(config.weights.linesCleared * cleared + staticValue(child), i);
+            ++nodes;
+        }
+
+        auto better = [](const std::pair<double, int> &a, const std::pair<double, int> &b) { return a.first > b.first; };
+        if (depth + 1 == totalDepth)
+        {
+            const auto &top = *std::min_element(s.ranked, s.ranked + count, better);
+            if (bestOut)
+                *bestOut = s.placements[top.second];
+            return top.first;
+        }
+
+        constexpr int MAX_EXPAND = 64;
+        const int expand = std::min(count, std::min(MAX_EXPAND, std::max(1, config.expandTop)));
+        std::partial_sort(s.ranked, s.ranked + expand, s.ranked + count, better);
+
+        double values[MAX_EXPAND];
+        const bool split = shouldSplit(depth);
+        WorkStealingPool::TaskGroup group;
+        for (int k = 0; k < expand; ++k)
+        {
+            const Placement p = s.placements[s.ranked[k].second];
+            auto child = [this, &board, &values, p, k, depth, bagMask, pathProb](ExpectimaxSearch &search)
+            {
+                Board next = board;
+                next.place(p);
+                const int cleared = next.clearLines();
+                values[k] = config.weights.linesCleared * cleared + search.chanceOrMax(next, depth + 1, bagMask, pathProb);
+            };
+            if (split)
+                config.pool->spawn(group, [this, child]() { ExpectimaxSearch sub(*this); child(sub); });
+            else
+                child(*this);
+        }
+        if (split)
+            config.pool->wait(group);
+
+        // Seeded from the first child, so a position where every line tops
+        // out still names a legal placement.
+        double best = values[0];
+        if (bestOut)
+            *bestOut = s.placements[s.ranked[0].second];
+        for (int k = 1; k < expand; ++k)
+        {
+            if (values[k] > best)
+            {
+                best = values[k];
+                if (bestOut)
+                    *bestOut = s.placements[s.ranked[k].second];
+            }
+        }
+        return best;
+    }
+
+    // The pieces still queued are part of the key: the bag mask does not
+    // say in which order the queue deals them, and the table outlives one
+    // search.
+    uint64_t tableKey(const Board &board, int depth, uint32_t bagMask, double pathProb) const
+    {
+        const uint64_t probBucket = (uint64_t)(pathProb * 4096);
+        uint64_t z = ((uint64_t)depth << 56) ^ ((uint64_t)bagMask << 40) ^ searchBreadthKey(config) ^ probBucket;
+        for (int i = depth; i < queueLen; ++i)
+            z = z * 31 + queue[i] + 1;
+        z = (z ^ (z >> 31)) * 0x9E3779B97F4A7C15ull;
+        return zobristHash(board) ^ z;
+    }
+
+    // Value of board with depth pieces placed: a max node while the queue is
+    // known, then the average over the pieces the bag can still deal.
+    double chanceOrMax(const Board &board, int depth, uint32_t bagMask, double pathProb)
+    {
+        uint64_t key = 0;
+        TableEntry cached{};
+        if (config.table != nullptr)
+        {
+            key = tableKey(board, depth, bagMask, pathProb);
+            if (config.table->probe(key, cached) && cached.depth >= totalDepth - depth)
+                return cached.score;
+        }
+
+        double value = 0;
+        Placement best{-1, 0, 0, 0};
+        if (depth < queueLen)
+        {
+            value = maxNode(board, queue[depth], depth, bagMask, pathProb, &best);
+        }
+        else
+        {
+            const uint32_t mask = bagMask != 0 ? bagMask : ALL_PIECES;
+            const int outcomes = popcount(mask);
+            const double prob = pathProb / outcomes;
+            if (prob < config.minProbability)
+                return staticValue(board);
+
+            double values[PIECE_COUNT] = {};
+            const bool split = shouldSplit(depth);
+            WorkStealingPool::TaskGroup group;
+            for (uint32_t m = mask; m != 0; m &= m - 1)
+            {
+                const int piece = __builtin_ctz(m);
+                auto outcome = [&board, &values, piece, depth, mask, prob](ExpectimaxSearch &search)
+                {
+                    values[piece] = search.maxNode(board, piece, depth, mask & ~(1u << piece), prob, nullptr);
+                };
+                if (split)
+                    config.pool->spawn(group, [this, outcome]() { ExpectimaxSearch sub(*this); outcome(sub); });
+                else
+                    outcome(*this);
+            }
+            if (split)
+                config.pool->wait(group);
+
+            for (int piece = 0; piece < PIECE_COUNT; ++piece)
+                value += values[piece];
+            value /= outcomes;
+        }
+
+        if (config.table != nullptr && !stopRequested(config))
+            config.table->store(key, TableEntry{value, best, totalDepth - depth});
+        return value;
+    }
+};
+
+// Expectimax over queue[0..queueLen) and then expectimaxDepth more pieces
+// drawn from bagMask (the pieces left in the current 7-bag after the queue).
+// With config.pool set the tree is split across its threads.
+inline SearchResult expectimaxSearch(const Board &root, const uint8_t *queue, int queueLen, uint32_t bagMask,
+                                     const BotConfig &config)
+{
+    // The whole decision is cached too: same board, queue and bag, same answer.
+    uint64_t rootKey = 0;
+    if (config.table != nullptr)
+    {
+        config.table->nextGeneration();
+        uint64_t z = ((uint64_t)bagMask << 48) ^ ((uint64_t)config.expectimaxDepth << 40) ^ searchBreadthKey(config) ^
+                     0x5EA7C400ull;
+        for (int i = 0; i < queueLen; ++i)
+            z = z * 31 + queue[i] + 1;
+        z = (z ^ (z >> 29)) * 0xBF58476D1CE4E5B9ull;
+        rootKey = zobristHash(root) ^ z;
+
+        TableEntry cached{};
+        if (config.table->probe(rootKey, cached) && cached.best.piece == queue[0])
+        {
+            SearchResult result;
+            result.found = true;
+            result.best = cached.best;
+            result.score = cached.score;
+            result.depth = cached.depth;
+            return result;
+        }
+    }
+
+    std::atomic<uint64_t> nodes{0};
+    SearchResult result;
+    result.best.piece = -1; // still -1 if the root piece has no placement
+    {
+        ExpectimaxSearch search(queue, queueLen, config, nodes);
+        result.score = search.maxNode(root, queue[0], 0, bagMask, 1.0, &result.best);
+        result.depth = search.totalDepth;
+    }
+    result.found = result.best.piece >= 0 && !stopRequested(config);
+    result.nodes = nodes.load();
+    if (config.table != nullptr && result.found)
+        config.table->store(rootKey, TableEntry{result.score, result.best, result.depth});
+    return result;
+}
+
+// Perft with the root placements, and deeper subtrees whenever workers are
+// idle, spread over the pool. Matches perft() exactly.
+inline uint64_t perftParallel(const Board &board, const uint8_t *queue, int depth, WorkStealingPool &pool,
+                              bool root = true)
+{
+    if (depth < 2 || (!root && (depth < 3 || !pool.hasIdleWorkers())))
+        return perft(board, queue, depth);
+
+    PlacementList placements;
+    generatePlacements(board, queue[0], placements);
+    std::vector<uint64_t> counts(placements.size());
+    WorkStealingPool::TaskGroup group;
+    for (int i = 0; i < placements.size(); ++i)
+    {
+        pool.spawn(group, [&, i]()
+        {
+            Board next = board;
+            next.place(placements[i]);
+            next.clearLines();
+            counts[i] = perftParallel(next, queue + 1, depth - 1, pool, false);
+        });
+    }
+    pool.wait(group);
+
+    uint64_t total = 0;
+    for (uint64_t c : counts)
+        total += c;
+    return total;
+}
+
+// One bot decision for queue[0] with queue[1..] as preview; bagMask holds the
+// pieces left in the bag after the queue (used by expectimax).
+inline SearchResult chooseMove(const Board &board, const uint8_t *queue, int queueLen, uint32_t bagMask,
+                               const BotConfig &config)
+{
+    if (config.expectimaxDepth > 0)
+        return expectimaxSearch(board, queue, queueLen, bagMask, config);
+    if (config.beamWidth > 0)
+    {
+        static thread_local TranspositionTable seen(16);
+        return beamSearch(board, queue, queueLen, config, threadArena(), seen);
+    }
+
+    SearchResult result;
+    const int evaluated = config.nn != nullptr ? config.nn->pickPlacement(board, queue[0], result.best)
+                                               : pickPlacement(board, queue[0], config.weights, result.best);
+    result.found = evaluated > 0;
+    result.nodes = evaluated;
+    result.depth = 1;
+    return result;
+}
+
+struct HeadlessResult
+{
+    int pieces;
+    int lines;
+    int score;
+    uint64_t evaluated;
+};
+
+// Plays one game without a terminal: 7-bag pieces with `preview` pieces of
+// look-ahead, instant placements, the same scoring and levels as the game.
+inline HeadlessResult playHeadlessGame(uint64_t seed, const BotConfig &config, int preview, int maxPieces)
+{
+    HeadlessResult result{};
+    Board board;
+    Bag bag(seed);
+    std::vector<uint8_t> queue;
+    int level = 1;
+
+    while (result.pieces < maxPieces)
+    {
+        while ((int)queue.size() < preview + 1)
+            queue.push_back((uint8_t)bag.next());
+
+        const SearchResult move = chooseMove(board, queue.data(), (int)queue.size(), bag.remainingMask(), config);
+        if (!move.found)
+            break;
+        result.evaluated += move.nodes;
+        board.place(move.best);
+        const int cleared = board.clearLines();
+        result.score += LINE_SCORES[cleared] * level;
+        result.lines += cleared;
+        level = result.lines / 10 + 1;
+        ++result.pieces;
+        queue.erase(queue.begin());
+    }
+    return result;
+}
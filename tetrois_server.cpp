@@ -0,0 +1,1126 @@
+// Multi-session game server: accepts terminals on a TCP port and/or a Unix
+// socket and runs one headless GameState per connection, rendered with the
+// ANSI backend straight into the socket.
+//
+// The main thread only accepts connections and hands each one to a worker,
+// round-robin. Every worker owns its sessions outright and runs its own
+// epoll loop: input is applied and the frame re-rendered as soon as it
+// arrives. Each session's next gravity deadline sits in the worker's timer
+// wheel, and one timerfd wakes the worker for the earliest of them, so idle
+// sessions cost nothing between deadlines. Sessions never move between
+// workers, so there are no locks on the game path.
+//
+// Spectators connect to the watch port and are handed to the worker that
+// runs the game they watch. Once a game has viewers, each frame its player
+// gets is also published to the game's FrameRing, and every viewer sends
+// the same shared buffers (tetrois_broadcast.hpp): the game is rendered
+// once however many people watch. Viewers joining late, or falling behind,
+// start again from a keyframe.
+//
+//   g++ -std=c++17 -O2 -pthread tetrois_server.cpp -o tetrois-server
+//   ./tetrois-server --port 7000 --threads 4
+//   telnet 127.0.0.1 7000
+//   ./tetrois-server --unix /tmp/tetrois.sock
+//   socat -,raw,echo=0 UNIX-CONNECT:/tmp/tetrois.sock
+//   ./tetrois-server --port 7000 --watch-port 7001
+//   telnet 127.0.0.1 7001
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "tetrois_ansi.hpp"
+#include "tetrois_broadcast.hpp"
+#include "tetrois_game.hpp"
+#include "tetrois_timer.hpp"
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: tetrois-server [--port N] [--bind ADDR] [--unix PATH] [--threads T]\n"
+                 "                      [--watch-port N] [--watch-unix PATH] [--seed S] [--stats SECS]\n"
+                 "                      [--raw]\n"
+                 "  listens on 127.0.0.1:7000 unless --port or --unix is given; TCP clients are\n"
+                 "  switched to character mode with telnet options unless --raw. Connections to\n"
+                 "  the watch port or socket spectate the oldest game (N: next game, Q: quit)\n");
+}
+
+using Clock = std::chrono::steady_clock;
+
+static std::atomic<bool> stopping{false};
+
+static void onSignal(int)
+{
+    stopping = true;
+}
+
+// Bytes waiting for a slow client before the session is dropped.
+constexpr size_t MAX_PENDING_OUTPUT = 256 * 1024;
+// A session with more than about one frame still queued for its client
+// (unsent, or in the socket and not yet read or acknowledged) is behind: new
+// frames are held back and coalesced into one of the latest state, retried
+// every BACKPRESSURE_RETRY_MS or when the socket drains. The player then
+// never sees the game more than a frame late, however slow the link.
+constexpr int MAX_QUEUED_OUTPUT = 2048;
+constexpr uint64_t BACKPRESSURE_RETRY_MS = 5;
+// Frames a game keeps for its viewers, and how many may wait on one viewer's
+// socket before it skips ahead to a keyframe.
+constexpr size_t VIEWER_RING_FRAMES = 64;
+constexpr size_t MAX_VIEWER_BACKLOG = 32;
+
+constexpr uint8_t TELNET_IAC = 255;
+constexpr uint8_t TELNET_SB = 250;
+constexpr uint8_t TELNET_SE = 240;
+constexpr uint8_t TELNET_WILL = 251;
+constexpr uint8_t TELNET_DONT = 254;
+// IAC WILL ECHO, IAC WILL SUPPRESS-GO-AHEAD: the client stops echoing and
+// line buffering, and sends every key as it is pressed.
+constexpr char TELNET_CHARACTER_MODE[] = "\xff\xfb\x01\xff\xfb\x03";
+
+// Where the key decoder is inside an escape or telnet sequence.
+enum class KeyState : uint8_t
+{
+    Text,
+    Escape,    // after ESC
+    Csi,       // after ESC [ or ESC O, until the final byte
+    Iac,       // after IAC
+    IacOption, // after IAC WILL/WONT/DO/DONT
+    Sub,       // inside IAC SB ... IAC SE
+    SubIac,
+};
+
+struct Viewer;
+
+// What a worker's epoll events point at.
+struct Endpoint
+{
+    bool isViewer;
+    bool closed = false; // gone, but events for it may still be in the batch
+
+    explicit Endpoint(bool isViewer) : isViewer(isViewer) {}
+    virtual ~Endpoint() = default;
+};
+
+struct Session : Endpoint
+{
+    int fd;
+    bool telnet;
+    uint64_t id;
+    size_t index = 0; // position in the owning worker's list
+    GameState game;
+    AnsiRenderer renderer;
+    std::string out;
+    size_t outSent = 0;
+    bool waitingForWrite = false; // EPOLLOUT armed
+    bool quit = false;            // the client asked to leave
+    bool stale = false;           // the game changed since the last frame sent
+    KeyState keys = KeyState::Text;
+    TickClock clock;            // game ticks due, from when the session started
+    TimerNode timer;            // the game's next deadline
+    std::unique_ptr<FrameRing> ring; // frames for viewers, while there are any
+    std::vector<Viewer *> viewers;
+
+    Session(int fd, bool telnet, uint64_t id, uint64_t seed, Clock::time_point now)
+        : Endpoint{false}, fd(fd), telnet(telnet), id(id), game(seed), clock(now)
+    {
+        timer.owner = this;
+    }
+};
+
+struct Viewer : Endpoint
+{
+    int fd;
+    bool telnet;
+    size_t index = 0;          // position in the owning worker's list
+    Session *game = nullptr;   // the game watched
+    FrameCursor cursor;
+    bool waitingForWrite = false;
+    bool quit = false;
+    bool next = false; // asked for the next game
+    KeyState keys = KeyState::Text;
+
+    Viewer(int fd, bool telnet) : Endpoint{true}, fd(fd), telnet(telnet) {}
+};
+
+// A connection on its way to a worker.
+struct Incoming
+{
+    int fd;
+    bool telnet;
+    bool viewer;
+    bool greeted; // a viewer handed over from another worker
+    uint64_t game; // for viewers, the game to watch
+};
+
+struct WorkerStats
+{
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> workNs{0}; // advancing, rendering and sending frames
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> inputs{0};
+    std::atomic<uint64_t> dropped{0};     // sessions closed for not reading their output
+    std::atomic<uint64_t> coalesced{0};   // frames never sent because the client was behind
+    std::atomic<uint64_t> viewerBytes{0};
+    std::atomic<uint64_t> skipped{0};     // frames viewers skipped for a keyframe
+    LatencyHistogram jitter;              // microseconds from a deadline to running it
+};
+
+static std::atomic<int> liveSessions{0};
+static std::atomic<int> liveViewers{0};
+static std::atomic<uint64_t> nextSessionId{0};
+
+class Worker;
+
+// Live games and the workers running them, so viewers can be handed to the
+// right worker.
+class GameDirectory
+{
+public:
+    void add(uint64_t id, Worker *worker)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        games[id] = worker;
+    }
+
+    void remove(uint64_t id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        games.erase(id);
+    }
+
+    // The first live game after `after`, wrapping around to the oldest.
+    // Returns false if no game is running.
+    bool next(uint64_t after, uint64_t &id, Worker *&worker)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (games.empty())
+            return false;
+        auto it = games.upper_bound(after);
+        if (it == games.end())
+            it = games.begin();
+        id = it->first;
+        worker = it->second;
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<uint64_t, Worker *> games;
+};
+
+static GameDirectory directory;
+
+static const char NO_GAMES[] = "No games are running right now.\r\n";
+
+class Worker
+{
+public:
+    explicit Worker(uint64_t seed) : seed(seed), origin(Clock::now())
+    {
+        epfd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        for (int *fd : {&wakeFd, &timerFd})
+        {
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.ptr = fd;
+            epoll_ctl(epfd, EPOLL_CTL_ADD, *fd, &ev);
+        }
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~Worker()
+    {
+        wake();
+        thread.join();
+        close(timerFd);
+        close(wakeFd);
+        close(epfd);
+    }
+
+    // Called from the accepting thread and from other workers.
+    void adopt(const Incoming &connection)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            incoming.push_back(connection);
+        }
+        wake();
+    }
+
+    void wake()
+    {
+        const uint64_t one = 1;
+        (void)!write(wakeFd, &one, sizeof(one));
+    }
+
+    WorkerStats stats;
+
+private:
+    int epfd;
+    int wakeFd;
+    int timerFd;
+    uint64_t seed;
+    // Wheel ticks are milliseconds since origin; steady_clock is
+    // CLOCK_MONOTONIC, the timerfd's clock.
+    Clock::time_point origin;
+    TimerWheel wheel;
+    uint64_t armedTick = 0;
+    std::thread thread;
+    std::mutex mutex;
+    std::vector<Incoming> incoming;
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::vector<std::unique_ptr<Viewer>> viewers;
+    std::unordered_map<uint64_t, Session *> games; // this worker's sessions by id
+    // Closing one endpoint can close others (a game's viewers), whose events
+    // may be later in the same epoll batch, so they are freed after it.
+    std::vector<std::unique_ptr<Endpoint>> retired;
+
+    void run()
+    {
+        epoll_event events[256];
+        while (!stopping)
+        {
+            const int n = epoll_wait(epfd, events, 256, -1);
+            for (int i = 0; i < n; ++i)
+            {
+                if (events[i].data.ptr == &wakeFd)
+                {
+                    acceptIncoming();
+                    continue;
+                }
+                if (events[i].data.ptr == &timerFd)
+                {
+                    runTimers();
+                    continue;
+                }
+                Endpoint *e = (Endpoint *)events[i].data.ptr;
+                if (e->closed)
+                    continue;
+                if (e->isViewer)
+                {
+                    Viewer &v = *static_cast<Viewer *>(e);
+                    bool alive = true;
+                    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                        alive = receive(v);
+                    if (alive && (events[i].events & EPOLLOUT))
+                        alive = flush(v);
+                    if (!alive)
+                        closeViewer(v, v.quit);
+                    else if (v.next)
+                        follow(v, v.game->id);
+                    continue;
+                }
+                Session &s = *static_cast<Session *>(e);
+                bool alive = true;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                    alive = receive(s);
+                if (alive && (events[i].events & EPOLLOUT))
+                    alive = flush(s) && (!s.stale || frame(s, Clock::now(), false));
+                if (!alive)
+                    closeSession(s, s.quit);
+            }
+            retired.clear();
+            armTimer();
+        }
+        while (!viewers.empty())
+            closeViewer(*viewers.back(), true);
+        while (!sessions.empty())
+            closeSession(*sessions.back(), true);
+    }
+
+    void acceptIncoming()
+    {
+        uint64_t count;
+        (void)!read(wakeFd, &count, sizeof(count));
+        std::vector<Incoming> connections;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            connections.swap(incoming);
+        }
+        const Clock::time_point now = Clock::now();
+        const Clock::time_point start = origin + std::chrono::milliseconds(tickAt(now));
+        for (const Incoming &c : connections)
+        {
+            if (c.viewer)
+            {
+                addViewer(c);
+                continue;
+            }
+            const uint64_t id = nextSessionId.fetch_add(1);
+            sessions.emplace_back(new Session(c.fd, c.telnet, id, seed + id, start));
+            Session &s = *sessions.back();
+            s.index = sessions.size() - 1;
+            games[id] = &s;
+            directory.add(id, this);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.ptr = static_cast<Endpoint *>(&s);
+            epoll_ctl(epfd, EPOLL_CTL_ADD, s.fd, &ev);
+            ++liveSessions;
+            if (s.telnet)
+                s.out.append(TELNET_CHARACTER_MODE, sizeof(TELNET_CHARACTER_MODE) - 1);
+            if (!frame(s, now, true))
+                closeSession(s, false);
+        }
+    }
+
+    // Sends the finishing escape codes if polite, then forgets the session.
+    // Its viewers move on to the next game.
+    void closeSession(Session &s, bool polite)
+    {
+        if (polite)
+        {
+            AnsiRenderer::finish(s.out);
+            flush(s);
+        }
+        directory.remove(s.id);
+        games.erase(s.id);
+        while (!s.viewers.empty())
+        {
+            Viewer &v = *s.viewers.back();
+            detach(v);
+            follow(v, s.id);
+        }
+        wheel.cancel(s.timer);
+        close(s.fd);
+        --liveSessions;
+        s.closed = true;
+        const size_t i = s.index;
+        retired.push_back(std::move(sessions[i]));
+        if (i + 1 != sessions.size())
+        {
+            sessions[i] = std::move(sessions.back());
+            sessions[i]->index = i;
+        }
+        sessions.pop_back();
+    }
+
+    // Runs gravity up to now and, if anything changed (or force), renders
+    // and sends a frame, to the player and to any viewers. While the client
+    // is behind, the frame waits and later changes fold into it. Returns
+    // false if the player went away.
+    bool frame(Session &s, Clock::time_point now, bool changed)
+    {
+        const auto start = Clock::now();
+        changed = s.game.advance(s.clock.due(now)) || changed;
+        if (changed)
+        {
+            if (s.stale)
+                stats.coalesced.fetch_add(1, std::memory_order_relaxed);
+            s.stale = true;
+        }
+        bool alive = true;
+        if (s.stale && !behind(s))
+        {
+            s.stale = false;
+            if (s.ring)
+            {
+                std::string bytes;
+                s.renderer.render(s.game, bytes);
+                s.out += bytes;
+                s.ring->publish(makeFrame(std::move(bytes)));
+            }
+            else
+                s.renderer.render(s.game, s.out);
+            alive = flush(s);
+            stats.frames.fetch_add(1, std::memory_order_relaxed);
+            if (s.ring)
+                broadcast(s);
+        }
+        // Wake for the game tick that changes something, rounded up to the
+        // wheel's millisecond, or sooner to retry a held-back frame.
+        uint64_t wake = s.stale ? tickAt(now) + BACKPRESSURE_RETRY_MS : UINT64_MAX;
+        const int untilEvent = s.game.nextEventTicks();
+        if (untilEvent >= 0)
+            wake = std::min(wake, tickAt(s.clock.at(s.clock.ticks + (uint64_t)untilEvent)) + 1);
+        if (wake == UINT64_MAX)
+            wheel.cancel(s.timer);
+        else
+            wheel.schedule(s.timer, wake);
+        stats.workNs.fetch_add((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count(),
+                               std::memory_order_relaxed);
+        return alive;
+    }
+
+    uint64_t tickAt(Clock::time_point t) const
+    {
+        return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(t - origin).count();
+    }
+
+    // Runs every session whose deadline has passed.
+    void runTimers()
+    {
+        uint64_t expirations;
+        (void)!read(timerFd, &expirations, sizeof(expirations));
+        armedTick = 0;
+        const Clock::time_point now = Clock::now();
+        wheel.advance(tickAt(now), [&](TimerNode &t)
+        {
+            Session &s = *(Session *)t.owner;
+            const auto late = now - (origin + std::chrono::milliseconds(t.expires));
+            stats.jitter.record((uint64_t)std::max<int64_t>(
+                0, std::chrono::duration_cast<std::chrono::microseconds>(late).count()));
+            if (!frame(s, now, false))
+                closeSession(s, false);
+        });
+    }
+
+    // Points the timerfd at the wheel's next deadline, if that changed.
+    void armTimer()
+    {
+        const uint64_t next = wheel.nextWake();
+        if (next == armedTick)
+            return;
+        itimerspec spec{};
+        if (next != 0)
+        {
+            const auto at = (origin + std::chrono::milliseconds(next)).time_since_epoch();
+            const auto secs = std::chrono::duration_cast<std::chrono::seconds>(at);
+            spec.it_value.tv_sec = (time_t)secs.count();
+            spec.it_value.tv_nsec = (long)std::chrono::duration_cast<std::chrono::nanoseconds>(at - secs).count();
+        }
+        timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        armedTick = next;
+    }
+
+    // Whether more than about a frame has still to reach the client: output
+    // we hold plus what sits in the socket (SIOCOUTQ: unread on a Unix
+    // socket, unacknowledged on TCP).
+    static bool behind(const Session &s)
+    {
+        int queued = 0;
+        if (ioctl(s.fd, TIOCOUTQ, &queued) != 0)
+            queued = 0;
+        return s.out.size() - s.outSent + (size_t)queued > (size_t)MAX_QUEUED_OUTPUT;
+    }
+
+    void watchWrites(int fd, Endpoint *e, bool &waiting, bool pending)
+    {
+        if (pending == waiting)
+            return;
+        epoll_event ev{};
+        ev.events = pending ? (uint32_t)(EPOLLIN | EPOLLOUT) : (uint32_t)EPOLLIN;
+        ev.data.ptr = e;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+        waiting = pending;
+    }
+
+    // Writes as much pending output as the socket takes. Returns false if
+    // the client is gone or has fallen too far behind.
+    bool flush(Session &s)
+    {
+        while (s.outSent < s.out.size())
+        {
+            const ssize_t n = send(s.fd, s.out.data() + s.outSent, s.out.size() - s.outSent, MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                s.outSent += (size_t)n;
+                stats.bytes.fetch_add((uint64_t)n, std::memory_order_relaxed);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            return false;
+        }
+
+        const bool pending = s.outSent < s.out.size();
+        if (!pending)
+        {
+            s.out.clear();
+            s.outSent = 0;
+        }
+        else if (s.out.size() - s.outSent > MAX_PENDING_OUTPUT)
+        {
+            stats.dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        watchWrites(s.fd, &s, s.waitingForWrite, pending);
+        return true;
+    }
+
+    // Reads and applies every key the client sent. Returns false once the
+    // client disconnects or quits (s.quit).
+    bool receive(Session &s)
+    {
+        const Clock::time_point now = Clock::now();
+        bool changed = s.game.advance(s.clock.due(now));
+
+        char buffer[4096];
+        for (;;)
+        {
+            const ssize_t n = read(s.fd, buffer, sizeof(buffer));
+            if (n == 0)
+                return false;
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                return false;
+            }
+            for (ssize_t i = 0; i < n; ++i)
+            {
+                int key = decode(s.keys, s.telnet, (uint8_t)buffer[i]);
+                if (key < 0)
+                    continue;
+                stats.inputs.fetch_add(1, std::memory_order_relaxed);
+                if (key == 'q' || key == 3) // q or ctrl-c
+                {
+                    s.quit = true;
+                    return false;
+                }
+                if (key == 12) // ctrl-l repaints
+                {
+                    s.renderer.invalidate();
+                    changed = true;
+                }
+                else if (s.game.over)
+                {
+                    if (key == ' ')
+                    {
+                        s.game = GameState(seed + nextSessionId.fetch_add(1));
+                        changed = true;
+                    }
+                }
+                else if (key == 'a' || key == 'D')
+                    changed |= s.game.apply(Input::Left);
+                else if (key == 'd' || key == 'C')
+                    changed |= s.game.apply(Input::Right);
+                else if (key == 's' || key == 'B')
+                    changed |= s.game.apply(Input::SoftDrop);
+                else if (key == 'w' || key == 'A')
+                    changed |= s.game.apply(Input::RotateCW);
+                else if (key == 'e')
+                    changed |= s.game.apply(Input::RotateCCW);
+                else if (key == ' ')
+                    changed |= s.game.apply(Input::HardDrop);
+            }
+        }
+        return frame(s, now, changed);
+    }
+
+    // A viewer arriving from the acceptor or another worker: it watches
+    // c.game if that is still here, or else the next live game.
+    void addViewer(const Incoming &c)
+    {
+        viewers.emplace_back(new Viewer(c.fd, c.telnet));
+        Viewer &v = *viewers.back();
+        v.index = viewers.size() - 1;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = static_cast<Endpoint *>(&v);
+        epoll_ctl(epfd, EPOLL_CTL_ADD, v.fd, &ev);
+        ++liveViewers;
+        if (v.telnet && !c.greeted)
+            v.cursor.push(makeFrame(std::string(TELNET_CHARACTER_MODE, sizeof(TELNET_CHARACTER_MODE) - 1)));
+        const auto found = games.find(c.game);
+        if (found == games.end())
+        {
+            follow(v, c.game);
+            return;
+        }
+        attach(v, *found->second);
+        if (!flush(v))
+            closeViewer(v, false);
+    }
+
+    // A repaint of what the player was last sent, which is where the ring's
+    // next frame starts from (the game itself may be ahead while the player
+    // is behind).
+    static FrameRef keyframe(const Session &s)
+    {
+        std::string bytes;
+        s.renderer.repaint(bytes);
+        return makeFrame(std::move(bytes));
+    }
+
+    // Starts v watching s from a keyframe. The game keeps a FrameRing only
+    // while someone watches.
+    void attach(Viewer &v, Session &s)
+    {
+        if (!s.ring)
+            s.ring.reset(new FrameRing(VIEWER_RING_FRAMES));
+        v.game = &s;
+        s.viewers.push_back(&v);
+        v.cursor.join(*s.ring, [&]() { return keyframe(s); });
+    }
+
+    void detach(Viewer &v)
+    {
+        Session &s = *v.game;
+        s.viewers.erase(std::find(s.viewers.begin(), s.viewers.end(), &v));
+        if (s.viewers.empty())
+            s.ring.reset();
+        v.game = nullptr;
+    }
+
+    // Queues s's newest frame for every viewer and sends what each socket
+    // takes. A viewer too far behind skips to a keyframe.
+    void broadcast(Session &s)
+    {
+        for (size_t i = 0; i < s.viewers.size();)
+        {
+            Viewer &v = *s.viewers[i];
+            const uint64_t skipped = v.cursor.catchUp(*s.ring, MAX_VIEWER_BACKLOG, [&]() { return keyframe(s); });
+            if (skipped != 0)
+                stats.skipped.fetch_add(skipped, std::memory_order_relaxed);
+            if (flush(v))
+                ++i;
+            else
+                closeViewer(v, false); // leaves s.viewers, so i now holds the next one
+        }
+    }
+
+    // Moves v to the live game after `after`, which may run on another
+    // worker; the connection is then handed over and v is gone. With no
+    // game left the viewer is told so and closed.
+    void follow(Viewer &v, uint64_t after)
+    {
+        v.next = false;
+        if (v.game)
+            detach(v);
+        uint64_t id;
+        Worker *worker;
+        if (!directory.next(after, id, worker))
+        {
+            std::string bye;
+            AnsiRenderer::finish(bye);
+            bye += NO_GAMES;
+            v.cursor.push(makeFrame(std::move(bye)));
+            flush(v);
+            closeViewer(v, false);
+            return;
+        }
+        const auto found = games.find(id);
+        if (worker == this && found != games.end())
+        {
+            attach(v, *found->second);
+            if (!flush(v))
+                closeViewer(v, false);
+            return;
+        }
+        // Anything still unsent is dropped: the other worker starts the
+        // viewer with a keyframe that clears the screen anyway.
+        epoll_ctl(epfd, EPOLL_CTL_DEL, v.fd, nullptr);
+        const Incoming handoff{v.fd, v.telnet, true, true, id};
+        forgetViewer(v);
+        worker->adopt(handoff);
+    }
+
+    void closeViewer(Viewer &v, bool polite)
+    {
+        if (polite)
+        {
+            std::string bye;
+            AnsiRenderer::finish(bye);
+            v.cursor.push(makeFrame(std::move(bye)));
+            flush(v);
+        }
+        if (v.game)
+            detach(v);
+        close(v.fd);
+        forgetViewer(v);
+    }
+
+    void forgetViewer(Viewer &v)
+    {
+        --liveViewers;
+        v.closed = true;
+        const size_t i = v.index;
+        retired.push_back(std::move(viewers[i]));
+        if (i + 1 != viewers.size())
+        {
+            viewers[i] = std::move(viewers.back());
+            viewers[i]->index = i;
+        }
+        viewers.pop_back();
+    }
+
+    // Sends a viewer's queued frames with one scatter-gather call per batch,
+    // straight from the shared buffers. Returns false if it is gone.
+    bool flush(Viewer &v)
+    {
+        while (!v.cursor.empty())
+        {
+            iovec iov[16];
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = (size_t)v.cursor.gather(iov, 16);
+            if (msg.msg_iovlen == 0)
+            {
+                v.cursor.consumed(0); // only empty frames left
+                continue;
+            }
+            const ssize_t n = sendmsg(v.fd, &msg, MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                v.cursor.consumed((size_t)n);
+                stats.viewerBytes.fetch_add((uint64_t)n, std::memory_order_relaxed);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            return false;
+        }
+        watchWrites(v.fd, &v, v.waitingForWrite, !v.cursor.empty());
+        return true;
+    }
+
+    // Viewer keys: n watches the next game, ctrl-l repaints, q leaves.
+    // Returns false once the viewer disconnects or quits (v.quit).
+    bool receive(Viewer &v)
+    {
+        char buffer[1024];
+        for (;;)
+        {
+            const ssize_t n = read(v.fd, buffer, sizeof(buffer));
+            if (n == 0)
+                return false;
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                return false;
+            }
+            for (ssize_t i = 0; i < n; ++i)
+            {
+                const int key = decode(v.keys, v.telnet, (uint8_t)buffer[i]);
+                if (key == 'q' || key == 3)
+                {
+                    v.quit = true;
+                    return false;
+                }
+                if (key == 'n')
+                    v.next = true;
+                else if (key == 12)
+                {
+                    Session &s = *v.game;
+                    v.cursor.join(*s.ring, [&]() { return keyframe(s); });
+                }
+            }
+        }
+        return v.next || flush(v);
+    }
+
+    // Key decoder. Returns a plain key, the final letter of an arrow key
+    // (A up, B down, C right, D left; uppercase letters are never sent as
+    // plain keys) or -1 while inside a sequence.
+    static int decode(KeyState &state, bool telnet, uint8_t c)
+    {
+        switch (state)
+        {
+        case KeyState::Text:
+            if (c == 0x1b)
+                state = KeyState::Escape;
+            else if (c == TELNET_IAC && telnet)
+                state = KeyState::Iac;
+            else if (c >= 'A' && c <= 'Z')
+                return c - 'A' + 'a';
+            else
+                return c;
+            return -1;
+        case KeyState::Escape:
+            state = c == '[' || c == 'O' ? KeyState::Csi : KeyState::Text;
+            return -1;
+        case KeyState::Csi:
+            if (c >= 0x40 && c <= 0x7e)
+            {
+                state = KeyState::Text;
+                return c >= 'A' && c <= 'D' ? c : -1;
+            }
+            return -1;
+        case KeyState::Iac:
+            if (c == TELNET_IAC)
+            {
+                state = KeyState::Text;
+                return c;
+            }
+            state = c == TELNET_SB ? KeyState::Sub
+                    : c >= TELNET_WILL && c <= TELNET_DONT ? KeyState::IacOption
+                                                            : KeyState::Text;
+            return -1;
+        case KeyState::IacOption:
+            state = KeyState::Text;
+            return -1;
+        case KeyState::Sub:
+            if (c == TELNET_IAC)
+                state = KeyState::SubIac;
+            return -1;
+        case KeyState::SubIac:
+            state = c == TELNET_SE ? KeyState::Text : KeyState::Sub;
+            return -1;
+        }
+        return -1;
+    }
+};
+
+static int listenTcp(const char *address, int port)
+{
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, address, &addr.sin_addr) != 1)
+    {
+        std::fprintf(stderr, "bad address %s\n", address);
+        return -1;
+    }
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4096) != 0)
+    {
+        std::fprintf(stderr, "cannot listen on %s:%d: %s\n", address, port, std::strerror(errno));
+        return -1;
+    }
+    return fd;
+}
+
+static int listenUnix(const char *path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(addr.sun_path))
+    {
+        std::fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    std::strcpy(addr.sun_path, path);
+    unlink(path);
+    const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 4096) != 0)
+    {
+        std::fprintf(stderr, "cannot listen on %s: %s\n", path, std::strerror(errno));
+        return -1;
+    }
+    return fd;
+}
+
+static double cpuSeconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int port = -1;
+    std::string bindAddress = "127.0.0.1";
+    std::string unixPath;
+    int watchPort = -1;
+    std::string watchUnixPath;
+    int threads = (int)std::min(4u, std::max(1u, std::thread::hardware_concurrency()));
+    uint64_t seed = (uint64_t)std::chrono::system_clock::now().time_since_epoch().count();
+    double statsSecs = 5;
+    bool telnet = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--port") && hasValue)
+            port = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--bind") && hasValue)
+            bindAddress = argv[++i];
+        else if (!std::strcmp(arg, "--unix") && hasValue)
+            unixPath = argv[++i];
+        else if (!std::strcmp(arg, "--watch-port") && hasValue)
+            watchPort = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--watch-unix") && hasValue)
+            watchUnixPath = argv[++i];
+        else if (!std::strcmp(arg, "--threads") && hasValue)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--seed") && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--stats") && hasValue)
+            statsSecs = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--raw"))
+            telnet = false;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (port < 0 && unixPath.empty())
+        port = 7000;
+    threads = std::max(1, threads);
+
+    // Thousands of sessions need thousands of descriptors.
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    int tcpFd = -1;
+    int unixFd = -1;
+    int watchTcpFd = -1;
+    int watchUnixFd = -1;
+    if (port >= 0 && (tcpFd = listenTcp(bindAddress.c_str(), port)) < 0)
+        return 1;
+    if (!unixPath.empty() && (unixFd = listenUnix(unixPath.c_str())) < 0)
+        return 1;
+    if (watchPort >= 0 && (watchTcpFd = listenTcp(bindAddress.c_str(), watchPort)) < 0)
+        return 1;
+    if (!watchUnixPath.empty() && (watchUnixFd = listenUnix(watchUnixPath.c_str())) < 0)
+        return 1;
+    for (int fd : {tcpFd, unixFd, watchTcpFd, watchUnixFd})
+    {
+        if (fd < 0)
+            continue;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (tcpFd >= 0)
+        std::fprintf(stderr, "listening on %s:%d\n", bindAddress.c_str(), port);
+    if (unixFd >= 0)
+        std::fprintf(stderr, "listening on %s\n", unixPath.c_str());
+    if (watchTcpFd >= 0)
+        std::fprintf(stderr, "spectators on %s:%d\n", bindAddress.c_str(), watchPort);
+    if (watchUnixFd >= 0)
+        std::fprintf(stderr, "spectators on %s\n", watchUnixPath.c_str());
+    const bool watching = watchTcpFd >= 0 || watchUnixFd >= 0;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int t = 0; t < threads; ++t)
+        workers.emplace_back(new Worker(seed));
+
+    size_t nextWorker = 0;
+    Clock::time_point lastReport = Clock::now();
+    uint64_t lastFrames = 0, lastWorkNs = 0, lastBytes = 0, lastViewerBytes = 0;
+    double lastCpu = cpuSeconds();
+    while (!stopping)
+    {
+        epoll_event events[16];
+        const int n = epoll_wait(epfd, events, 16, 250);
+        for (int i = 0; i < n; ++i)
+        {
+            const int listenFd = events[i].data.fd;
+            for (;;)
+            {
+                const int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0)
+                {
+                    if (errno == EMFILE || errno == ENFILE)
+                        std::fprintf(stderr, "out of file descriptors at %d sessions\n", liveSessions.load());
+                    break;
+                }
+                const bool tcp = listenFd == tcpFd || listenFd == watchTcpFd;
+                if (tcp)
+                {
+                    const int one = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                }
+                if (listenFd == watchTcpFd || listenFd == watchUnixFd)
+                {
+                    // Spectators start on the oldest game, on its worker.
+                    uint64_t game;
+                    Worker *worker;
+                    if (directory.next(UINT64_MAX, game, worker))
+                        worker->adopt({fd, telnet && tcp, true, false, game});
+                    else
+                    {
+                        (void)!send(fd, NO_GAMES, sizeof(NO_GAMES) - 1, MSG_NOSIGNAL);
+                        close(fd);
+                    }
+                    continue;
+                }
+                workers[nextWorker]->adopt({fd, telnet && tcp, false, false, 0});
+                nextWorker = (nextWorker + 1) % workers.size();
+            }
+        }
+
+        const Clock::time_point now = Clock::now();
+        const double secs = std::chrono::duration<double>(now - lastReport).count();
+        if (statsSecs > 0 && secs >= statsSecs)
+        {
+            uint64_t frames = 0, workNs = 0, bytes = 0, dropped = 0, coalesced = 0, viewerBytes = 0, skipped = 0;
+            LatencyHistogram jitter;
+            for (const auto &w : workers)
+            {
+                frames += w->stats.frames.load();
+                workNs += w->stats.workNs.load();
+                bytes += w->stats.bytes.load();
+                dropped += w->stats.dropped.load();
+                coalesced += w->stats.coalesced.load();
+                viewerBytes += w->stats.viewerBytes.load();
+                skipped += w->stats.skipped.load();
+                jitter.merge(w->stats.jitter, true);
+            }
+            const double cpu = cpuSeconds();
+            const int live = liveSessions.load();
+            const uint64_t df = frames - lastFrames;
+            std::fprintf(stderr,
+                         "%d sessions, %.0f frames/s, %.2f us/frame in game code, %.2f us/frame total cpu, "
+                         "%.1f KB/s per session, %llu frames coalesced, %llu dropped\n",
+                         live, df / secs, df ? (workNs - lastWorkNs) / 1e3 / df : 0.0,
+                         df ? (cpu - lastCpu) * 1e6 / df : 0.0,
+                         live ? (bytes - lastBytes) / 1024.0 / secs / live : 0.0, (unsigned long long)coalesced,
+                         (unsigned long long)dropped);
+            std::fprintf(stderr, "  %llu deadlines, jitter p50 %llu us, p99 %llu us, p99.9 %llu us, max %llu us\n",
+                         (unsigned long long)jitter.count(), (unsigned long long)jitter.percentile(0.5),
+                         (unsigned long long)jitter.percentile(0.99), (unsigned long long)jitter.percentile(0.999),
+                         (unsigned long long)jitter.percentile(1));
+            const int viewing = liveViewers.load();
+            if (watching)
+                std::fprintf(stderr, "  %d viewers, %.1f KB/s per viewer, %llu frames skipped\n", viewing,
+                             viewing ? (viewerBytes - lastViewerBytes) / 1024.0 / secs / viewing : 0.0,
+                             (unsigned long long)skipped);
+            lastReport = now;
+            lastFrames = frames;
+            lastWorkNs = workNs;
+            lastBytes = bytes;
+            lastViewerBytes = viewerBytes;
+            lastCpu = cpu;
+        }
+    }
+
+    workers.clear(); // each worker says goodbye to its sessions
+    if (unixFd >= 0)
+        unlink(unixPath.c_str());
+    if (watchUnixFd >= 0)
+        unlink(watchUnixPath.c_str());
+    return 0;
+}
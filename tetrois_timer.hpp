@@ -0,0 +1,244 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Timing utilities for the server side: a hierarchical timer wheel that
+// holds one deadline per session, and a log-linear latency histogram.
+
+// A timer embedded in its owner. Scheduling or cancelling only relinks the
+// node, so neither allocates.
+struct TimerNode
+{
+    TimerNode *prev = nullptr;
+    TimerNode *next = nullptr;
+    uint64_t expires = 0; // in wheel ticks
+    int slot = -1;        // level * SLOTS + slot while scheduled
+    void *owner = nullptr;
+
+    bool scheduled() const { return prev != nullptr; }
+};
+
+// Hierarchical timer wheel: LEVELS wheels of 64 slots, each slot of level L
+// spanning 64^L ticks. A timer sits in the lowest level whose span holds its
+// distance from now, and moves down a level when time reaches its slot, so
+// scheduling, cancelling and firing are O(1) per timer regardless of how
+// many are pending. With 1 ms ticks four levels reach 4.6 hours; further
+// deadlines are clamped to the horizon.
+class TimerWheel
+{
+public:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr uint64_t HORIZON = (uint64_t)1 << (SLOT_BITS * LEVELS);
+
+    explicit TimerWheel(uint64_t now = 0) : current(now)
+    {
+        for (auto &level : slots)
+        {
+            for (TimerNode &head : level)
+                head.prev = head.next = &head;
+        }
+    }
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    uint64_t now() const { return current; }
+
+    // Schedules (or reschedules) t to fire at tick expires; deadlines that
+    // have already passed fire on the next tick.
+    void schedule(TimerNode &t, uint64_t expires)
+    {
+        if (t.scheduled())
+            cancel(t);
+        if (expires <= current)
+            expires = current + 1;
+        if (expires - current >= HORIZON)
+            expires = current + HORIZON - 1;
+        t.expires = expires;
+        insert(t);
+    }
+
+    void cancel(TimerNode &t)
+    {
+        if (!t.scheduled())
+            return;
+        t.prev->next = t.next;
+        t.next->prev = t.prev;
+        const TimerNode &head = slots[t.slot / SLOTS][t.slot % SLOTS];
+        if (head.next == &head)
+            occupied[t.slot / SLOTS] &= ~(1ull << (t.slot % SLOTS));
+        t.prev = t.next = nullptr;
+        t.slot = -1;
+    }
+
+    // Moves time forward to tick to, calling fire(TimerNode &) for every
+    // timer that expires on the way, in deadline order. fire may schedule
+    // timers again, including the one it was called for.
+    template <typename Fn>
+    void advance(uint64_t to, const Fn &fire)
+    {
+        while (current < to)
+        {
+            // Skip empty stretches a level-0 lap at a time.
+            if (occupied[0] == 0 && (current & (SLOTS - 1)) != SLOTS - 1)
+            {
+                const uint64_t lapEnd = (current | (SLOTS - 1));
+                if (lapEnd < to)
+                {
+                    current = lapEnd;
+                    continue;
+                }
+                current = to;
+                break;
+            }
+            ++current;
+            if ((current & (SLOTS - 1)) == 0)
+            {
+                int top = 1;
+                while (top + 1 < LEVELS && (current & ((1ull << (SLOT_BITS * (top + 1))) - 1)) == 0)
+                    ++top;
+                for (int level = top; level >= 1; --level)
+                    cascade(level, (int)((current >> (SLOT_BITS * level)) & (SLOTS - 1)));
+            }
+
+            TimerNode &head = slots[0][current & (SLOTS - 1)];
+            while (head.next != &head)
+            {
+                TimerNode &t = *head.next;
+                cancel(t);
+                fire(t);
+            }
+        }
+    }
+
+    // The earliest tick at which advance() may have work: the next occupied
+    // level-0 slot, or the next time a higher slot moves down. Returns 0 if
+    // no timer is pending.
+    uint64_t nextWake() const
+    {
+        for (int level = 0; level < LEVELS; ++level)
+        {
+            const uint64_t mask = occupied[level];
+            if (mask == 0)
+                continue;
+            const int shift = SLOT_BITS * level;
+            const int pos = (int)((current >> shift) & (SLOTS - 1));
+            // Slots after pos come first, wrapping around past the end.
+            const uint64_t rotated = pos + 1 < SLOTS ? (mask >> (pos + 1)) | (mask << (SLOTS - pos - 1)) : mask;
+            const int distance = __builtin_ctzll(rotated) + 1;
+            return ((current >> shift) + (uint64_t)distance) << shift;
+        }
+        return 0;
+    }
+
+private:
+    TimerNode slots[LEVELS][SLOTS];
+    uint64_t occupied[LEVELS] = {}; // bit per non-empty slot
+    uint64_t current;
+
+    void insert(TimerNode &t)
+    {
+        // The lowest level at which t and now share every higher digit.
+        int level = 0;
+        while (level + 1 < LEVELS && (t.expires >> (SLOT_BITS * (level + 1))) != (current >> (SLOT_BITS * (level + 1))))
+            ++level;
+        const int slot = (int)((t.expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+        TimerNode &head = slots[level][slot];
+        t.slot = level * SLOTS + slot;
+        t.prev = head.prev;
+        t.next = &head;
+        head.prev->next = &t;
+        head.prev = &t;
+        occupied[level] |= 1ull << slot;
+    }
+
+    void cascade(int level, int slot)
+    {
+        TimerNode &head = slots[level][slot];
+        TimerNode *t = head.next;
+        head.prev = head.next = &head;
+        occupied[level] &= ~(1ull << slot);
+        while (t != &head)
+        {
+            TimerNode *next = t->next;
+            insert(*t);
+            t = next;
+        }
+    }
+};
+
+// Log-linear histogram of non-negative values (e.g. microseconds): exact
+// below 128, then 64 buckets per power of two, so percentiles are within
+// 1.6%. Counters are relaxed atomics, so one thread may record while
+// another takes percentiles.
+class LatencyHistogram
+{
+public:
+    static constexpr int SUB_BITS = 6;
+    static constexpr int BUCKETS = (64 - SUB_BITS + 1) << SUB_BITS;
+
+    void record(uint64_t value)
+    {
+        counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Adds other's counts to this histogram and, if drain, zeroes other.
+    void merge(LatencyHistogram &other, bool drain)
+    {
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            const uint64_t c = drain ? other.counts[i].exchange(0, std::memory_order_relaxed)
+                                     : other.counts[i].load(std::memory_order_relaxed);
+            if (c != 0)
+                counts[i].fetch_add(c, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const
+    {
+        uint64_t total = 0;
+        for (const auto &c : counts)
+            total += c.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // The smallest bucket value with at least fraction q of the samples at
+    // or below it (q = 0.99 for p99, 1 for the maximum).
+    uint64_t percentile(double q) const
+    {
+        const uint64_t total = count();
+        if (total == 0)
+            return 0;
+        const uint64_t rank = q >= 1 ? total : (uint64_t)(q * total) + 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i)
+        {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return valueOf(i);
+        }
+        return valueOf(BUCKETS - 1);
+    }
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS] = {};
+
+    static int bucketOf(uint64_t v)
+    {
+        if (v < (2u << SUB_BITS))
+            return (int)v;
+        const int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+        return ((shift + 1) << SUB_BITS) + (int)((v >> shift) - (1u << SUB_BITS));
+    }
+
+    static uint64_t valueOf(int bucket)
+    {
+        if (bucket < (2 << SUB_BITS))
+            return (uint64_t)bucket;
+        const int shift = (bucket >> SUB_BITS) - 1;
+        return ((uint64_t)(bucket & ((1 << SUB_BITS) - 1)) + (1u << SUB_BITS)) << shift;
+    }
+};
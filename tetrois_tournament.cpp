@@ -0,0 +1,452 @@
+// Bot tournament: plays bot builds against each other on identical seeds and
+// reports Elo differences with 95% confidence intervals. Every pair of bots
+// runs a sequential probability ratio test (H0: elo0, H1: elo1); the
+// tournament stops as soon as all pairs are decided, or at --rounds.
+//
+// Modes:
+//   score     every bot plays each seed alone, the higher score wins
+//   survival  the same, the bot that places more pieces wins
+//   versus    two bots play the same seed side by side, line clears send
+//             garbage to the opponent and the first to top out loses;
+//             every seed is played twice with the sides swapped
+//
+// The two versus games of a seed deal the same pieces, so their results are
+// far from independent. The statistics therefore count a round, not a game,
+// as one trial: each round's score is the mean of its games (0, 1/4, ...,
+// 1 for a versus pair, as in pentanomial SPRT), and the interval and the
+// LLR come from the variance of those round scores.
+//
+//   g++ -std=c++17 -O2 -pthread tetrois_tournament.cpp -o tetrois-tournament
+//   ./tetrois-tournament --bot name=base --bot name=tuned,weights=weights.txt
+//   ./tetrois-tournament --mode versus --bot name=greedy --bot name=beam,beam=16,preview=1
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tetrois_engine.hpp"
+#include "tetrois_nn.hpp"
+#include "tetrois_pool.hpp"
+#include "tetrois_search.hpp"
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: tetrois-tournament --bot SPEC --bot SPEC [...] [--mode score|survival|versus]\n"
+                 "                          [--rounds N] [--batch N] [--pieces MAX] [--seed S] [--threads T]\n"
+                 "                          [--elo0 E] [--elo1 E] [--alpha A] [--beta B]\n"
+                 "  SPEC is a comma separated list of name=, beam=, preview=, expectimax=, expand=,\n"
+                 "  weights=FILE and nn=FILE; a round is one seed for every bot (two games per pair in versus)\n");
+}
+
+enum class Mode
+{
+    Score,
+    Survival,
+    Versus,
+};
+
+struct Bot
+{
+    std::string name;
+    BotConfig config;
+    int preview = 0;
+    std::unique_ptr<NnEvaluator> nn;
+};
+
+static bool parseBot(const std::string &spec, Bot &bot)
+{
+    size_t pos = 0;
+    while (pos <= spec.size())
+    {
+        const size_t end = std::min(spec.find(',', pos), spec.size());
+        const std::string item = spec.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty())
+            continue;
+        const size_t eq = item.find('=');
+        if (eq == std::string::npos)
+            return false;
+        const std::string key = item.substr(0, eq);
+        const std::string value = item.substr(eq + 1);
+        if (key == "name")
+            bot.name = value;
+        else if (key == "beam")
+            bot.config.beamWidth = std::atoi(value.c_str());
+        else if (key == "preview")
+            bot.preview = std::atoi(value.c_str());
+        else if (key == "expectimax")
+            bot.config.expectimaxDepth = std::atoi(value.c_str());
+        else if (key == "expand")
+            bot.config.expandTop = std::atoi(value.c_str());
+        else if (key == "weights")
+        {
+            if (!loadWeights(value.c_str(), bot.config.weights))
+            {
+                std::fprintf(stderr, "cannot read weights from %s\n", value.c_str());
+                return false;
+            }
+        }
+        else if (key == "nn")
+        {
+            bot.nn.reset(new NnEvaluator());
+            if (!bot.nn->load(value.c_str()))
+            {
+                std::fprintf(stderr, "cannot read network from %s\n", value.c_str());
+                return false;
+            }
+            bot.config.nn = bot.nn.get();
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+// One versus game between a and b on the same piece sequence, a moving
+// first each turn. Returns a's result: 1 win, 0.5 draw, 0 loss.
+static double playVersus(const Bot &a, const Bot &b, uint64_t seed, int maxPieces)
+{
+    struct Side
+    {
+        const Bot *bot;
+        Board board;
+        Bag bag;
+        std::vector<uint8_t> queue;
+        int pendingGarbage = 0;
+    };
+    Side sides[2] = {{&a, Board(), Bag(seed), {}, 0}, {&b, Board(), Bag(seed), {}, 0}};
+    Rng holes(seed ^ 0x6A7BA6Eull);
+
+    for (int piece = 0; piece < maxPieces; ++piece)
+    {
+        for (int s = 0; s < 2; ++s)
+        {
+            Side &me = sides[s];
+            Side &them = sides[1 - s];
+            if (me.pendingGarbage > 0)
+            {
+                const bool alive = me.board.addGarbage(me.pendingGarbage, holes.below(GRID_COLS));
+                me.pendingGarbage = 0;
+                if (!alive)
+                    return s == 0 ? 0.0 : 1.0;
+            }
+            while ((int)me.queue.size() < me.bot->preview + 1)
+                me.queue.push_back((uint8_t)me.bag.next());
+
+            const SearchResult move = chooseMove(me.board, me.queue.data(), (int)me.queue.size(),
+                                                 me.bag.remainingMask(), me.bot->config);
+            if (!move.found)
+                return s == 0 ? 0.0 : 1.0;
+            me.board.place(move.best);
+            const int cleared = me.board.clearLines();
+            me.queue.erase(me.queue.begin());
+
+            // Clears cancel garbage still waiting for us before any is sent.
+            int sent = GARBAGE_LINES[cleared];
+            const int cancelled = std::min(sent, me.pendingGarbage);
+            me.pendingGarbage -= cancelled;
+            them.pendingGarbage += sent - cancelled;
+        }
+    }
+    return 0.5;
+}
+
+struct PairStats
+{
+    int a;
+    int b;
+    int wins = 0;
+    int draws = 0;
+    int losses = 0;
+    int rounds[5] = {}; // rounds by the first bot's score in quarters: rounds[i] scored i / 4
+    int decision = 0; // 0 running, 1 accepted H1 (a stronger by elo1), -1 accepted H0
+};
+
+static double eloFromScore(double score)
+{
+    score = std::min(std::max(score, 1e-6), 1 - 1e-6);
+    return -400.0 * std::log10(1.0 / score - 1.0);
+}
+
+static double scoreFromElo(double elo)
+{
+    return 1.0 / (1.0 + std::pow(10.0, -elo / 400.0));
+}
+
+// Mean score per game and its standard error, from the round score counts.
+static void scoreStats(const int rounds[5], double &mean, double &stderror)
+{
+    int n = 0;
+    double total = 0;
+    for (int i = 0; i < 5; ++i)
+    {
+        n += rounds[i];
+        total += rounds[i] * (i / 4.0);
+    }
+    mean = n > 0 ? total / n : 0.5;
+    if (n < 2)
+    {
+        stderror = 0.5;
+        return;
+    }
+    double var = 0;
+    for (int i = 0; i < 5; ++i)
+        var += rounds[i] * (i / 4.0 - mean) * (i / 4.0 - mean);
+    stderror = std::sqrt(var / n / n);
+}
+
+// Log-likelihood ratio of H1 (elo1) over H0 (elo0) in the normal
+// approximation used by engine testing frameworks, over rounds.
+static double sprtLlr(const PairStats &p, double elo0, double elo1)
+{
+    int n = 0;
+    for (int count : p.rounds)
+        n += count;
+    double mean, stderror;
+    scoreStats(p.rounds, mean, stderror);
+    const double var = stderror * stderror * n;
+    if (n == 0 || var <= 0)
+        return 0;
+    const double s0 = scoreFromElo(elo0);
+    const double s1 = scoreFromElo(elo1);
+    return n * (s1 - s0) * (2 * mean - s0 - s1) / (2 * var);
+}
+
+static void printRow(const char *label, int wins, int draws, int losses, const int rounds[5])
+{
+    double mean, stderror;
+    scoreStats(rounds, mean, stderror);
+    const double elo = eloFromScore(mean);
+    const double lo = eloFromScore(mean - 1.96 * stderror);
+    const double hi = eloFromScore(mean + 1.96 * stderror);
+    std::printf("%-28s %6d %6d %6d %6d %7.1f%% %7.1f  [%7.1f, %7.1f]\n", label, wins + draws + losses, wins, draws,
+                losses, 100 * mean, elo, lo, hi);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<std::unique_ptr<Bot>> bots;
+    Mode mode = Mode::Score;
+    int rounds = 2000;
+    int batch = 0;
+    int maxPieces = 1000;
+    uint64_t seed = 1;
+    int threads = (int)std::thread::hardware_concurrency();
+    double elo0 = 0;
+    double elo1 = 10;
+    double alpha = 0.05;
+    double beta = 0.05;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--bot") && hasValue)
+        {
+            bots.emplace_back(new Bot());
+            bots.back()->name = "bot" + std::to_string(bots.size());
+            if (!parseBot(argv[++i], *bots.back()))
+            {
+                std::fprintf(stderr, "bad bot spec '%s'\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (!std::strcmp(arg, "--mode") && hasValue)
+        {
+            const std::string m = argv[++i];
+            if (m == "score")
+                mode = Mode::Score;
+            else if (m == "survival")
+                mode = Mode::Survival;
+            else if (m == "versus")
+                mode = Mode::Versus;
+            else
+            {
+                usage();
+                return 2;
+            }
+        }
+        else if (!std::strcmp(arg, "--rounds") && hasValue)
+            rounds = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--batch") && hasValue)
+            batch = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--pieces") && hasValue)
+            maxPieces = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--seed") && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--threads") && hasValue)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--elo0") && hasValue)
+            elo0 = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--elo1") && hasValue)
+            elo1 = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--alpha") && hasValue)
+            alpha = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--beta") && hasValue)
+            beta = std::atof(argv[++i]);
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (bots.size() < 2)
+    {
+        usage();
+        return 2;
+    }
+    threads = std::max(1, threads);
+    if (batch < 1)
+        batch = std::max(8, 4 * threads);
+
+    std::vector<PairStats> pairs;
+    for (int a = 0; a < (int)bots.size(); ++a)
+    {
+        for (int b = a + 1; b < (int)bots.size(); ++b)
+            pairs.push_back(PairStats{a, b});
+    }
+    const double lowerBound = std::log(beta / (1 - alpha));
+    const double upperBound = std::log((1 - beta) / alpha);
+
+    WorkStealingPool pool(threads);
+    const auto start = std::chrono::steady_clock::now();
+    int played = 0;
+    bool decided = false;
+    while (played < rounds && !decided)
+    {
+        const int count = std::min(batch, rounds - played);
+        // Solo modes: one result per bot and seed, compared pairwise below.
+        // Versus: two games per pair and seed.
+        std::vector<HeadlessResult> solo(mode == Mode::Versus ? 0 : count * bots.size());
+        std::vector<double> versus(mode == Mode::Versus ? count * pairs.size() * 2 : 0);
+        WorkStealingPool::TaskGroup group;
+        for (int r = 0; r < count; ++r)
+        {
+            const uint64_t roundSeed = seed + (uint64_t)(played + r);
+            if (mode != Mode::Versus)
+            {
+                for (size_t k = 0; k < bots.size(); ++k)
+                {
+                    pool.spawn(group, [&, r, k, roundSeed]()
+                    {
+                        const Bot &bot = *bots[k];
+                        solo[r * bots.size() + k] = playHeadlessGame(roundSeed, bot.config, bot.preview, maxPieces);
+                    });
+                }
+                continue;
+            }
+            for (size_t p = 0; p < pairs.size(); ++p)
+            {
+                for (int swap = 0; swap < 2; ++swap)
+                {
+                    pool.spawn(group, [&, r, p, swap, roundSeed]()
+                    {
+                        const Bot &a = *bots[pairs[p].a];
+                        const Bot &b = *bots[pairs[p].b];
+                        const double result = swap ? 1.0 - playVersus(b, a, roundSeed, maxPieces)
+                                                   : playVersus(a, b, roundSeed, maxPieces);
+                        versus[(r * pairs.size() + p) * 2 + swap] = result;
+                    });
+                }
+            }
+        }
+        pool.wait(group);
+
+        for (int r = 0; r < count; ++r)
+        {
+            for (size_t p = 0; p < pairs.size(); ++p)
+            {
+                PairStats &ps = pairs[p];
+                std::vector<double> results;
+                if (mode == Mode::Versus)
+                {
+                    results.push_back(versus[(r * pairs.size() + p) * 2]);
+                    results.push_back(versus[(r * pairs.size() + p) * 2 + 1]);
+                }
+                else
+                {
+                    const HeadlessResult &a = solo[r * bots.size() + ps.a];
+                    const HeadlessResult &b = solo[r * bots.size() + ps.b];
+                    const long long da = mode == Mode::Score ? a.score : a.pieces;
+                    const long long db = mode == Mode::Score ? b.score : b.pieces;
+                    results.push_back(da > db ? 1.0 : da < db ? 0.0 : 0.5);
+                }
+                double total = 0;
+                for (double result : results)
+                {
+                    ps.wins += result == 1.0;
+                    ps.draws += result == 0.5;
+                    ps.losses += result == 0.0;
+                    total += result;
+                }
+                ++ps.rounds[(int)std::lround(total / results.size() * 4)];
+            }
+        }
+        played += count;
+
+        decided = true;
+        for (PairStats &ps : pairs)
+        {
+            if (ps.decision == 0)
+            {
+                const double llr = sprtLlr(ps, elo0, elo1);
+                ps.decision = llr >= upperBound ? 1 : llr <= lowerBound ? -1 : 0;
+            }
+            decided = decided && ps.decision != 0;
+        }
+    }
+    const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const char *modeName = mode == Mode::Score ? "score" : mode == Mode::Survival ? "survival" : "versus";
+    std::printf("%s mode, %d rounds from seed %llu, %.1f s%s\n", modeName, played, (unsigned long long)seed, secs,
+                decided ? " (stopped: every pair decided)" : "");
+    std::printf("%-28s %6s %6s %6s %6s %8s %7s  %s\n", "", "games", "wins", "draws", "losses", "score", "elo",
+                "95% interval");
+
+    std::printf("pairs (first bot's view), SPRT elo0 %.1f elo1 %.1f alpha %.2f beta %.2f\n", elo0, elo1, alpha, beta);
+    for (const PairStats &ps : pairs)
+    {
+        const std::string label = bots[ps.a]->name + " vs " + bots[ps.b]->name;
+        printRow(label.c_str(), ps.wins, ps.draws, ps.losses, ps.rounds);
+        const double llr = sprtLlr(ps, elo0, elo1);
+        std::printf("%-28s LLR %.2f in [%.2f, %.2f]: %s\n", "", llr, lowerBound, upperBound,
+                    ps.decision > 0 ? "H1 accepted, first bot stronger"
+                                    : ps.decision < 0 ? "H0 accepted, no gain of elo1" : "undecided");
+    }
+
+    std::printf("ratings (against the field)\n");
+    for (int k = 0; k < (int)bots.size(); ++k)
+    {
+        int wins = 0, draws = 0, losses = 0;
+        int rounds[5] = {};
+        for (const PairStats &ps : pairs)
+        {
+            if (ps.a == k)
+            {
+                wins += ps.wins;
+                losses += ps.losses;
+                draws += ps.draws;
+                for (int i = 0; i < 5; ++i)
+                    rounds[i] += ps.rounds[i];
+            }
+            else if (ps.b == k)
+            {
+                wins += ps.losses;
+                losses += ps.wins;
+                draws += ps.draws;
+                for (int i = 0; i < 5; ++i)
+                    rounds[i] += ps.rounds[4 - i];
+            }
+        }
+        printRow(bots[k]->name.c_str(), wins, draws, losses, rounds);
+    }
+    return 0;
+}
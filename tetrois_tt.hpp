@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "tetrois_engine.hpp"
+
+// Transposition table shared by all search threads without locks, laid out
+// like a chess engine's: fixed size, one 64-byte bucket (cache line) of four
+// entries per index. Each entry stores key ^ data next to data; a torn write
+// from a racing thread makes the check fail, so readers see a miss instead
+// of another position's value. Replacement is racy by design: the worst case
+// is losing an entry, never reading a wrong one.
+
+struct TableEntry
+{
+    double score;
+    Placement best; // piece < 0 when no placement was stored
+    int depth;      // plies searched below the entry, used for replacement
+};
+
+struct TableStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t collisions; // stores that evicted a live entry for another key
+};
+
+class SharedTranspositionTable
+{
+    static constexpr int BUCKET_ENTRIES = 4;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> data{0};
+    };
+
+    struct alignas(64) Bucket
+    {
+        Slot slots[BUCKET_ENTRIES];
+    };
+
+    std::vector<Bucket> buckets;
+    uint64_t mask;
+    std::atomic<uint8_t> generation{1};
+    mutable std::atomic<uint64_t> hits{0};
+    mutable std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> stores{0};
+    std::atomic<uint64_t> collisions{0};
+
+    // data layout: score as float (32) | x+4 (5) | y+4 (6) | rot (2) | piece+1 (3) | depth (8) | generation (8)
+    static uint64_t pack(const TableEntry &e, uint8_t gen)
+    {
+        const float score = (float)e.score;
+        uint32_t scoreBits;
+        std::memcpy(&scoreBits, &score, sizeof(scoreBits));
+        uint64_t move = 0;
+        if (e.best.piece >= 0)
+        {
+            move = (uint64_t)(e.best.x + 4) | (uint64_t)(e.best.y + 4) << 5 | (uint64_t)e.best.rot << 11 |
+                   (uint64_t)(e.best.piece + 1) << 13;
+        }
+        const uint64_t depth = (uint64_t)(e.depth < 0 ? 0 : e.depth > 255 ? 255 : e.depth);
+        return (uint64_t)scoreBits | move << 32 | depth << 48 | (uint64_t)gen << 56;
+    }
+
+    static TableEntry unpack(uint64_t data)
+    {
+        TableEntry e{};
+        const uint32_t scoreBits = (uint32_t)data;
+        float score;
+        std::memcpy(&score, &scoreBits, sizeof(score));
+        e.score = score;
+        const uint32_t move = (uint32_t)(data >> 32) & 0xFFFF;
+        e.best.piece = (int8_t)((move >> 13) - 1);
+        e.best.rot = (int8_t)((move >> 11) & 3);
+        e.best.y = (int8_t)(((move >> 5) & 63) - 4);
+        e.best.x = (int8_t)((move & 31) - 4);
+        e.depth = (int)((data >> 48) & 0xFF);
+        return e;
+    }
+
+public:
+    // Rounds the size down to a power of two buckets, at least one.
+    explicit SharedTranspositionTable(size_t megabytes)
+    {
+        size_t count = 1;
+        while (count * 2 * sizeof(Bucket) <= megabytes * 1024 * 1024)
+            count *= 2;
+        buckets = std::vector<Bucket>(count);
+        mask = count - 1;
+    }
+
+    size_t bytes() const { return buckets.size() * sizeof(Bucket); }
+
+    // Entries from older generations are the first to be replaced.
+    void nextGeneration() { generation.fetch_add(1, std::memory_order_relaxed); }
+
+    bool probe(uint64_t key, TableEntry &out) const
+    {
+        const Bucket &b = buckets[key & mask];
+        for (const Slot &s : b.slots)
+        {
+            const uint64_t data = s.data.load(std::memory_order_relaxed);
+            if ((s.check.load(std::memory_order_relaxed) ^ data) == key && data != 0)
+            {
+                out = unpack(data);
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Overwrites the entry for key if present, else an empty slot, else the
+    // oldest and shallowest entry of the bucket.
+    void store(uint64_t key, const TableEntry &entry)
+    {
+        const uint8_t gen = generation.load(std::memory_order_relaxed);
+        const uint64_t data = pack(entry, gen);
+        Bucket &b = buckets[key & mask];
+
+        Slot *victim = &b.slots[0];
+        int victimRank = 1 << 30;
+        bool live = false;
+        for (Slot &s : b.slots)
+        {
+            const uint64_t old = s.data.load(std::memory_order_relaxed);
+            if (old == 0 || (s.check.load(std::memory_order_relaxed) ^ old) == key)
+            {
+                victim = &s;
+                live = false;
+                break;
+            }
+            const int age = (uint8_t)(gen - (uint8_t)(old >> 56));
+            const int rank = (int)((old >> 48) & 0xFF) - 256 * age;
+            if (rank < victimRank)
+            {
+                victimRank = rank;
+                victim = &s;
+                live = true;
+            }
+        }
+
+        victim->check.store(key ^ data, std::memory_order_relaxed);
+        victim->data.store(data, std::memory_order_relaxed);
+        stores.fetch_add(1, std::memory_order_relaxed);
+        if (live)
+            collisions.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    TableStats stats() const
+    {
+        return TableStats{hits.load(), misses.load(), stores.load(), collisions.load()};
+    }
+};
@@ -0,0 +1,326 @@
+// Genetic tuner for the evaluator weights: every generation each candidate
+// plays the same seeded headless games (common random numbers, so the
+// ranking reflects the weights rather than the luck of the draw), the games
+// are spread over a work-stealing pool, and the next generation is bred from
+// the best. The population is checkpointed after every generation; rerunning
+// with the same --checkpoint resumes. The best weights go to --out, which
+// the game and tetrois-bench read with --weights.
+//
+//   g++ -std=c++17 -O2 -pthread tetrois_tune.cpp -o tetrois-tune
+//   ./tetrois-tune --generations 30 --games 200 --pieces 500 --out weights.txt
+//   ./tetrois --bot --weights weights.txt
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tetrois_bot.hpp"
+#include "tetrois_engine.hpp"
+#include "tetrois_pool.hpp"
+#include "tetrois_search.hpp"
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: tetrois-tune [--generations N] [--population P] [--games G] [--pieces MAX] [--seed S]\n"
+                 "                    [--threads T] [--sigma X] [--beam WIDTH] [--preview N] [--weights FILE]\n"
+                 "                    [--checkpoint FILE] [--out FILE]\n"
+                 "  every candidate plays the same G games per generation, capped at MAX pieces each\n"
+                 "  --weights seeds the population, --checkpoint resumes an earlier run\n");
+}
+
+struct Candidate
+{
+    double w[WEIGHT_COUNT];
+    double fitness = 0;
+};
+
+// Only the direction of the weight vector matters to the bot (every search
+// compares sums of weighted features), so candidates are kept at unit length.
+static void normalize(Candidate &c)
+{
+    double norm = 0;
+    for (double v : c.w)
+        norm += v * v;
+    norm = std::sqrt(norm);
+    if (norm > 0)
+    {
+        for (double &v : c.w)
+            v /= norm;
+    }
+}
+
+static EvalWeights toWeights(const Candidate &c)
+{
+    EvalWeights w{};
+    for (int i = 0; i < WEIGHT_COUNT; ++i)
+        w.*WEIGHT_FIELDS[i] = c.w[i];
+    return w;
+}
+
+static Candidate fromWeights(const EvalWeights &w)
+{
+    Candidate c;
+    for (int i = 0; i < WEIGHT_COUNT; ++i)
+        c.w[i] = w.*WEIGHT_FIELDS[i];
+    normalize(c);
+    return c;
+}
+
+static double uniform(Rng &rng)
+{
+    return (rng.next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gaussian(Rng &rng)
+{
+    const double u = std::max(uniform(rng), 1e-300);
+    return std::sqrt(-2.0 * std::log(u)) * std::cos(6.283185307179586 * uniform(rng));
+}
+
+struct TuneState
+{
+    int generation = 0;
+    uint64_t rngState = 0;
+    std::vector<Candidate> population;
+};
+
+// Text so that a checkpoint can be inspected (and edited) by hand.
+static bool saveCheckpoint(const std::string &path, const TuneState &state)
+{
+    const std::string tmp = path + ".tmp";
+    FILE *f = std::fopen(tmp.c_str(), "w");
+    if (f == nullptr)
+        return false;
+    std::fprintf(f, "tetrois-tune 1\ngeneration %d\nrng %llu\n", state.generation,
+                 (unsigned long long)state.rngState);
+    for (const Candidate &c : state.population)
+    {
+        std::fprintf(f, "member");
+        for (double v : c.w)
+            std::fprintf(f, " %.17g", v);
+        std::fprintf(f, "\n");
+    }
+    if (std::fclose(f) != 0)
+        return false;
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+static bool loadCheckpoint(const std::string &path, TuneState &state)
+{
+    FILE *f = std::fopen(path.c_str(), "r");
+    if (f == nullptr)
+        return false;
+    int version = 0;
+    unsigned long long rngState = 0;
+    bool ok = std::fscanf(f, "tetrois-tune %d generation %d rng %llu", &version, &state.generation, &rngState) == 3 &&
+              version == 1;
+    state.rngState = rngState;
+    state.population.clear();
+    while (ok)
+    {
+        Candidate c;
+        if (std::fscanf(f, " member") == EOF)
+            break;
+        for (double &v : c.w)
+            ok = ok && std::fscanf(f, "%lf", &v) == 1;
+        if (ok)
+            state.population.push_back(c);
+    }
+    std::fclose(f);
+    return ok && !state.population.empty();
+}
+
+// Plays every candidate through games [firstSeed, firstSeed + games) and
+// stores the mean score as its fitness.
+static void evaluatePopulation(std::vector<Candidate> &population, const BotConfig &base, uint64_t firstSeed,
+                               int games, int preview, int maxPieces, WorkStealingPool &pool)
+{
+    std::vector<BotConfig> configs(population.size(), base);
+    for (size_t c = 0; c < population.size(); ++c)
+        configs[c].weights = toWeights(population[c]);
+
+    std::vector<double> scores(population.size() * games);
+    WorkStealingPool::TaskGroup group;
+    for (size_t c = 0; c < population.size(); ++c)
+    {
+        for (int g = 0; g < games; ++g)
+        {
+            pool.spawn(group, [&, c, g]()
+            {
+                scores[c * games + g] = playHeadlessGame(firstSeed + g, configs[c], preview, maxPieces).score;
+            });
+        }
+    }
+    pool.wait(group);
+
+    for (size_t c = 0; c < population.size(); ++c)
+    {
+        double sum = 0;
+        for (int g = 0; g < games; ++g)
+            sum += scores[c * games + g];
+        population[c].fitness = sum / games;
+    }
+}
+
+static const Candidate &tournament(const std::vector<Candidate> &ranked, Rng &rng)
+{
+    constexpr int ROUNDS = 3;
+    int best = rng.below((int)ranked.size());
+    for (int i = 1; i < ROUNDS; ++i)
+        best = std::min(best, rng.below((int)ranked.size())); // ranked is sorted best first
+    return ranked[best];
+}
+
+// Elites survive unchanged; every other child blends two tournament winners
+// gene by gene and gets gaussian noise on some genes.
+static std::vector<Candidate> breed(const std::vector<Candidate> &ranked, int elites, double sigma, Rng &rng)
+{
+    std::vector<Candidate> next(ranked.begin(), ranked.begin() + std::min(elites, (int)ranked.size()));
+    while (next.size() < ranked.size())
+    {
+        const Candidate &a = tournament(ranked, rng);
+        const Candidate &b = tournament(ranked, rng);
+        Candidate child;
+        for (int i = 0; i < WEIGHT_COUNT; ++i)
+        {
+            const double t = uniform(rng);
+            child.w[i] = a.w[i] + t * (b.w[i] - a.w[i]);
+            if (uniform(rng) < 0.3)
+                child.w[i] += sigma * gaussian(rng);
+        }
+        normalize(child);
+        next.push_back(child);
+    }
+    return next;
+}
+
+int main(int argc, char **argv)
+{
+    int generations = 30;
+    int populationSize = 24;
+    int games = 200;
+    int maxPieces = 500;
+    uint64_t seed = 1;
+    int threads = (int)std::thread::hardware_concurrency();
+    double sigma = 0.1;
+    int preview = 0;
+    std::string weightsPath;
+    std::string checkpointPath = "tetrois-tune.ckpt";
+    std::string outPath = "weights.txt";
+    BotConfig config;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--generations") && hasValue)
+            generations = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--population") && hasValue)
+            populationSize = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--games") && hasValue)
+            games = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--pieces") && hasValue)
+            maxPieces = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--seed") && hasValue)
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--threads") && hasValue)
+            threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--sigma") && hasValue)
+            sigma = std::atof(argv[++i]);
+        else if (!std::strcmp(arg, "--beam") && hasValue)
+            config.beamWidth = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--preview") && hasValue)
+            preview = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--weights") && hasValue)
+            weightsPath = argv[++i];
+        else if (!std::strcmp(arg, "--checkpoint") && hasValue)
+            checkpointPath = argv[++i];
+        else if (!std::strcmp(arg, "--out") && hasValue)
+            outPath = argv[++i];
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    if (threads < 1)
+        threads = 1;
+    if (populationSize < 2 || games < 1)
+    {
+        usage();
+        return 2;
+    }
+
+    TuneState state;
+    if (loadCheckpoint(checkpointPath, state))
+    {
+        std::printf("resuming %s at generation %d with %zu candidates\n", checkpointPath.c_str(), state.generation,
+                    state.population.size());
+    }
+    else
+    {
+        EvalWeights start = DEFAULT_WEIGHTS;
+        if (!weightsPath.empty() && !loadWeights(weightsPath.c_str(), start))
+        {
+            std::fprintf(stderr, "cannot read weights from %s\n", weightsPath.c_str());
+            return 1;
+        }
+        Rng rng(seed ^ 0x7E7A0157ull);
+        state.population.push_back(fromWeights(start));
+        while ((int)state.population.size() < populationSize)
+        {
+            Candidate c = state.population[0];
+            for (double &v : c.w)
+                v += 2 * sigma * gaussian(rng);
+            normalize(c);
+            state.population.push_back(c);
+        }
+        state.rngState = rng.state;
+    }
+
+    WorkStealingPool pool(threads);
+    Rng rng(state.rngState);
+    const int elites = std::max(1, (int)state.population.size() / 12);
+    std::printf("%-5s %12s %12s %8s\n", "gen", "best score", "mean score", "seconds");
+
+    for (; state.generation < generations; ++state.generation)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const uint64_t firstSeed = seed * 1000003 + (uint64_t)state.generation * games;
+        evaluatePopulation(state.population, config, firstSeed, games, preview, maxPieces, pool);
+        std::stable_sort(state.population.begin(), state.population.end(),
+                         [](const Candidate &a, const Candidate &b) { return a.fitness > b.fitness; });
+
+        double mean = 0;
+        for (const Candidate &c : state.population)
+            mean += c.fitness;
+        mean /= state.population.size();
+        const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::printf("%-5d %12.1f %12.1f %8.2f\n", state.generation, state.population[0].fitness, mean, secs);
+        std::fflush(stdout);
+
+        if (!saveWeights(outPath.c_str(), toWeights(state.population[0])))
+        {
+            std::fprintf(stderr, "cannot write %s\n", outPath.c_str());
+            return 1;
+        }
+
+        state.population = breed(state.population, elites, sigma, rng);
+        state.rngState = rng.state;
+        TuneState saved = state;
+        ++saved.generation;
+        if (!saveCheckpoint(checkpointPath, saved))
+        {
+            std::fprintf(stderr, "cannot write %s\n", checkpointPath.c_str());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,1750 @@
+// Versus play for 2..8 players, in deterministic lockstep or with
+// rollback, over a local TCP or Unix socket. Every line clear of 2 or more
+// sends garbage rows to an opponent; the last board standing wins.
+//
+// The host (--serve) relays inputs and referees: each peer sends its input
+// for tick t + delay while it simulates tick t, the host broadcasts a tick's
+// inputs once every seat's has arrived, and each peer only simulates a tick
+// whose inputs it has. Nothing but inputs crosses the wire. The host runs
+// the match too, and every input carries the sender's match hash at the
+// latest tick it has all the inputs for, so a peer that diverges is caught
+// within a tick of the host hearing from it. With a round trip under delay
+// ticks (33 ms at the default delay of 2) nobody ever waits.
+//
+// With --rollback N the host instead relays each input the moment it
+// arrives, and peers run up to N ticks past the last tick they have every
+// input for, predicting that the others press nothing. When an input
+// arrives that contradicts a tick already run, the peer restores its
+// snapshot of that tick and runs forward again, all before its next tick.
+// Latency beyond the input delay then costs replays instead of stalls.
+// --proxy sits between join and serve and adds latency and jitter;
+// --rollback-speed measures how many ticks a replay gets through per ms.
+//
+// --bench plays whole matches in-process over socket pairs, bots on every
+// seat, and reports input-to-confirmation latency, stalls and throughput.
+// It is the multiplayer load case: pass --hz 0 to simulate as fast as the
+// peers can exchange inputs.
+//
+//   g++ -std=c++17 -O2 -pthread tetrois_versus.cpp -o tetrois-versus
+//   ./tetrois-versus --serve --players 2 --port 7100
+//   ./tetrois-versus --join --port 7100
+//   ./tetrois-versus --join --port 7100 --input bot
+//   ./tetrois-versus --bench --matches 64 --players 4 --ticks 1200
+//   ./tetrois-versus --bench --rollback 8 --delay 1 --latency-ms 40 --jitter-ms 10
+//   ./tetrois-versus --proxy --listen-port 7101 --port 7100 --latency-ms 50 --jitter-ms 15
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "tetrois_ansi.hpp"
+#include "tetrois_search.hpp"
+#include "tetrois_timer.hpp"
+#include "tetrois_versus.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+// The host checks hashes up to this many ticks old.
+constexpr uint32_t HASH_RING = 1024;
+constexpr int MAX_DELAY = 120;
+constexpr int MAX_ROLLBACK = 64;
+
+static void usage()
+{
+    std::fprintf(stderr,
+                 "usage: tetrois-versus --serve [--players N] [--delay TICKS] [--rollback TICKS] [--ticks MAX]\n"
+                 "                      [--seed S] [--port N | --unix PATH]\n"
+                 "       tetrois-versus --join [--host ADDR] [--port N | --unix PATH] [--input keys|bot|random]\n"
+                 "       tetrois-versus --bench [--matches M] [--players N] [--delay TICKS] [--rollback TICKS]\n"
+                 "                      [--ticks MAX] [--hz HZ] [--threads T] [--input bot|random] [--seed S]\n"
+                 "                      [--latency-ms MS] [--jitter-ms MS] [--desync-at TICK]\n"
+                 "       tetrois-versus --proxy [--listen-port N | --listen-unix PATH] [--host ADDR]\n"
+                 "                      [--port N | --unix PATH] [--latency-ms MS] [--jitter-ms MS]\n"
+                 "       tetrois-versus --rollback-speed [--seed S]\n"
+                 "  a tick is 1/%d s; --rollback 0 (the default) plays in lockstep, up to %d predicts that\n"
+                 "  far ahead. Lockstep needs --delay 1 or more. --hz 0 runs the bench unpaced.\n"
+                 "  --desync-at corrupts one board per match at that tick and fails unless every match\n"
+                 "  reports the desync\n",
+                 TICK_HZ, MAX_ROLLBACK);
+}
+
+static bool sendMessage(int fd, const VersusMessage &m)
+{
+    const char *p = (const char *)&m;
+    size_t left = sizeof(m);
+    while (left > 0)
+    {
+        const ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        left -= (size_t)n;
+    }
+    return true;
+}
+
+// Splits a socket's byte stream into whole messages.
+struct MessageReader
+{
+    char buffer[sizeof(VersusMessage) * 64];
+    size_t used = 0;
+
+    // Reads what is available and calls on(message) for each complete one.
+    // Returns false once the connection is closed or failed.
+    template <typename Fn>
+    bool read(int fd, const Fn &on)
+    {
+        for (;;)
+        {
+            const ssize_t n = recv(fd, buffer + used, sizeof(buffer) - used, MSG_DONTWAIT);
+            if (n == 0)
+                return false;
+            if (n < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+            used += (size_t)n;
+            size_t pos = 0;
+            for (; used - pos >= sizeof(VersusMessage); pos += sizeof(VersusMessage))
+            {
+                VersusMessage m;
+                std::memcpy(&m, buffer + pos, sizeof(m));
+                if (!on(m))
+                    return false;
+            }
+            std::memmove(buffer, buffer + pos, used - pos);
+            used -= pos;
+        }
+    }
+};
+
+// The relay and referee: collects every seat's inputs, runs the match
+// itself and compares the hashes the peers report against its own. In
+// lockstep it broadcasts each tick once every seat's input is in; with
+// rollback it passes each input on to the other seats as it arrives.
+class VersusHost
+{
+public:
+    uint64_t hashChecks = 0;
+    int64_t desyncTick = -1;
+    int desyncSeat = -1;
+    bool disconnected = false;
+
+    VersusHost(const std::vector<int> &fds, uint64_t seed, int delay, int window, uint32_t tickLimit)
+        : fds(fds), delay(delay), window(window), match((int)fds.size(), seed, tickLimit), queued(fds.size()),
+          readers(fds.size()), reported(fds.size())
+    {
+    }
+
+    // Seats everyone. The first `delay` ticks have no inputs, so every peer
+    // runs them without waiting.
+    bool start()
+    {
+        for (size_t s = 0; s < fds.size(); ++s)
+        {
+            VersusMessage m{};
+            m.type = VersusMessage::START;
+            m.seat = (uint8_t)s;
+            m.players = (uint8_t)match.players;
+            m.delay = (uint8_t)delay;
+            m.tick = match.tickLimit;
+            m.value = match.seed;
+            m.aux = (uint32_t)window;
+            if (!sendMessage(fds[s], m))
+                return false;
+        }
+        hashes[0] = match.hash();
+        const uint8_t none[MAX_PLAYERS] = {};
+        for (int t = 0; t < delay && !match.over(); ++t)
+            stepMatch(none);
+        return true;
+    }
+
+    const VersusMatch &state() const { return match; }
+
+    int fdOf(int seat) const { return fds[seat]; }
+
+    bool finished() const { return match.over() || desyncTick >= 0 || disconnected; }
+
+    // Handles input from one seat. Returns false once the match is finished.
+    bool onReadable(int seat)
+    {
+        const bool open = readers[seat].read(fds[seat], [&](const VersusMessage &m)
+        {
+            if (m.type != VersusMessage::INPUT)
+                return false;
+            reported[seat] = Report{true, m.aux, m.value};
+            queued[seat].push_back(m.inputs[0]);
+            if (window > 0)
+            {
+                VersusMessage relay = m;
+                relay.seat = (uint8_t)seat;
+                for (size_t s = 0; s < fds.size(); ++s)
+                {
+                    if ((int)s != seat)
+                        sendMessage(fds[s], relay);
+                }
+            }
+            return true;
+        });
+        if (!open && !match.over())
+            disconnected = true;
+        pump();
+        return !finished();
+    }
+
+private:
+    // The latest hash a seat reported, checked once the host reaches its tick.
+    struct Report
+    {
+        bool pending = false;
+        uint32_t tick = 0;
+        uint64_t hash = 0;
+    };
+
+    std::vector<int> fds;
+    int delay;
+    int window;
+    VersusMatch match;
+    std::vector<std::deque<uint8_t>> queued; // inputs from match.tick onwards, per seat
+    std::vector<MessageReader> readers;
+    std::vector<Report> reported;
+    uint64_t hashes[HASH_RING]; // match hash at each tick, before it runs
+
+    void stepMatch(const uint8_t *inputs)
+    {
+        match.step(inputs);
+        hashes[match.tick % HASH_RING] = match.hash();
+    }
+
+    void check()
+    {
+        for (size_t s = 0; s < reported.size() && desyncTick < 0; ++s)
+        {
+            Report &r = reported[s];
+            if (!r.pending || r.tick > match.tick)
+                continue;
+            r.pending = false;
+            if (match.tick - r.tick >= HASH_RING)
+                continue;
+            ++hashChecks;
+            if (hashes[r.tick % HASH_RING] == r.hash)
+                continue;
+            desyncTick = r.tick;
+            desyncSeat = (int)s;
+            VersusMessage m{};
+            m.type = VersusMessage::DESYNC;
+            m.tick = r.tick;
+            m.seat = (uint8_t)s;
+            for (int fd : fds)
+                sendMessage(fd, m);
+        }
+    }
+
+    // Runs (and in lockstep broadcasts) every tick whose inputs are all in,
+    // then checks the hashes that have become checkable.
+    void pump()
+    {
+        while (!finished())
+        {
+            check();
+            if (desyncTick >= 0)
+                return;
+            for (const auto &q : queued)
+            {
+                if (q.empty())
+                    return;
+            }
+            VersusMessage m{};
+            m.type = VersusMessage::FRAME;
+            m.tick = match.tick;
+            for (size_t s = 0; s < queued.size(); ++s)
+            {
+                m.inputs[s] = queued[s].front();
+                queued[s].pop_front();
+            }
+            if (window == 0)
+            {
+                for (int fd : fds)
+                    sendMessage(fd, m);
+            }
+            stepMatch(m.inputs);
+        }
+    }
+};
+
+// One seat's copy of the match.
+//
+// In lockstep it only runs ticks whose inputs are all confirmed.
+//
+// With rollback (GGPO-style) it runs ahead of the confirmed inputs by up to
+// `window` ticks, predicting that the other players press nothing, and
+// snapshots the match before every tick. When a remote input turns out to
+// differ from the prediction, the next step restores the snapshot of that
+// tick and runs the ticks since again with what is now known. Predicting
+// "no key" rather than "the same key again" suits inputs that are presses,
+// not held buttons: a repeated hard drop would be wrong every time. Once
+// `window` ticks are unconfirmed the peer waits, which bounds a rollback.
+class VersusPeer
+{
+public:
+    int fd;
+    int seat = 0;
+    int delay = 0;
+    int window = 0; // rollback window, 0 = lockstep
+    VersusMatch match;
+    int64_t desyncTick = -1;
+    bool closed = false;
+    uint64_t bytes = 0;                  // sent and received
+    LatencyHistogram *latency = nullptr; // input sent -> its tick confirmed, microseconds
+
+    // Rollback statistics.
+    uint64_t rollbacks = 0;
+    uint64_t replayedTicks = 0;
+    int maxDepth = 0;
+    uint64_t maxReplayNs = 0; // longest single restore and replay
+
+    int64_t corruptAt = -1; // testing: our own board gets a stray garbage row at this tick
+
+    explicit VersusPeer(int fd) : fd(fd) {}
+
+    // Waits for the host's START.
+    bool handshake()
+    {
+        VersusMessage m;
+        size_t got = 0;
+        while (got < sizeof(m))
+        {
+            const ssize_t n = recv(fd, (char *)&m + got, sizeof(m) - got, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            got += (size_t)n;
+        }
+        if (m.type != VersusMessage::START || m.players < 1 || m.players > MAX_PLAYERS || m.seat >= m.players ||
+            m.aux > MAX_ROLLBACK)
+            return false;
+        seat = m.seat;
+        delay = m.delay;
+        window = (int)m.aux;
+        match = VersusMatch(m.players, m.value, m.tick);
+        confirmed = (uint32_t)delay;
+        for (int s = 0; s < MAX_PLAYERS; ++s)
+            received[s] = (uint32_t)delay;
+        if (window > 0)
+        {
+            size_t ring = 1;
+            while (ring <= (size_t)window)
+                ring *= 2;
+            snapshots.resize(ring);
+        }
+        bytes += sizeof(m);
+        return true;
+    }
+
+    // Takes in inputs from the host. Returns false once nothing more will
+    // come (the host closed, or reported a desync).
+    bool onReadable()
+    {
+        const bool open = reader.read(fd, [&](const VersusMessage &m)
+        {
+            bytes += sizeof(m);
+            if (m.type == VersusMessage::DESYNC)
+            {
+                desyncTick = m.tick;
+                return false;
+            }
+            if (window == 0)
+            {
+                if (m.type != VersusMessage::FRAME || m.tick != confirmed || m.tick - match.tick >= INPUT_RING / 2)
+                    return false;
+                std::memcpy(inputs[m.tick % INPUT_RING], m.inputs, MAX_PLAYERS);
+                confirm(m.tick + 1);
+                return true;
+            }
+            if (m.type != VersusMessage::INPUT || m.seat >= match.players || m.seat == seat ||
+                m.tick != received[m.seat] || m.tick - confirmed >= INPUT_RING / 2)
+                return false;
+            // The input was predicted as 0 if its tick has already run.
+            inputs[m.tick % INPUT_RING][m.seat] = m.inputs[0];
+            ++received[m.seat];
+            if (m.tick < match.tick && m.inputs[0] != 0 && (replayFrom < 0 || m.tick < replayFrom))
+                replayFrom = m.tick;
+            updateConfirmed();
+            return true;
+        });
+        if (!open)
+            closed = true;
+        return open;
+    }
+
+    // Rolls back and replays if an input arrived for a tick that already
+    // ran on a wrong prediction. Nothing to do in lockstep.
+    void settle()
+    {
+        if (window > 0)
+            replay();
+    }
+
+    // The match is over and no input still to come can change that.
+    bool finished() const
+    {
+        return match.over() && (window == 0 || (confirmed >= match.tick && replayFrom < 0));
+    }
+
+    // Whether the next tick may run: its inputs are in, or with rollback it
+    // is inside the prediction window.
+    bool ready() const
+    {
+        if (match.over())
+            return false;
+        return window == 0 ? confirmed > match.tick : match.tick < confirmed + (uint32_t)window;
+    }
+
+    // Sends this seat's input for tick + delay, then runs the next tick. Once
+    // the host is gone the input goes nowhere, but confirmed ticks still run.
+    void step(uint8_t input)
+    {
+        if (window > 0)
+            replay();
+
+        // The hash of the last tick whose inputs are all known, which with
+        // rollback may be a snapshot a few ticks back.
+        VersusMessage m{};
+        m.type = VersusMessage::INPUT;
+        m.tick = match.tick + (uint32_t)delay;
+        m.aux = std::min(confirmed, match.tick);
+        m.value = m.aux == match.tick ? match.hash() : snapshots[m.aux % snapshots.size()].hash();
+        m.inputs[0] = input;
+        sentAt[m.tick % INPUT_RING] = Clock::now();
+        if (!closed && sendMessage(fd, m))
+            bytes += sizeof(m);
+        else
+            closed = true;
+
+        if (window == 0)
+        {
+            run();
+            return;
+        }
+        inputs[m.tick % INPUT_RING][seat] = input;
+        received[seat] = m.tick + 1;
+        updateConfirmed();
+        advance();
+    }
+
+private:
+    // Inputs arrive at most 2 * MAX_DELAY + MAX_ROLLBACK ticks ahead of the
+    // confirmed tick; slots are cleared INPUT_RING / 2 ticks behind it.
+    static constexpr uint32_t INPUT_RING = 1024;
+
+    MessageReader reader;
+    uint32_t confirmed = 0;                  // ticks below this have all their inputs
+    uint32_t received[MAX_PLAYERS];          // rollback: ticks below this have seat s's input
+    uint8_t inputs[INPUT_RING][MAX_PLAYERS] = {}; // known inputs by tick, 0 where not known yet
+    Clock::time_point sentAt[INPUT_RING];
+    std::vector<VersusMatch> snapshots;      // rollback: the match before each tick, by tick
+    int64_t replayFrom = -1;                 // rollback: earliest tick that ran on a wrong prediction
+
+    void confirm(uint32_t upTo)
+    {
+        const Clock::time_point now = Clock::now();
+        for (; confirmed < upTo; ++confirmed)
+        {
+            if (latency != nullptr && confirmed >= (uint32_t)delay)
+            {
+                const auto us = std::chrono::duration_cast<std::chrono::microseconds>(now - sentAt[confirmed % INPUT_RING]);
+                latency->record((uint64_t)std::max<int64_t>(0, us.count()));
+            }
+            // The slot comes round again for tick + INPUT_RING; unknown
+            // inputs read as 0, the prediction.
+            if (window > 0 && confirmed >= (uint32_t)delay + INPUT_RING / 2)
+                std::memset(inputs[(confirmed - INPUT_RING / 2) % INPUT_RING], 0, MAX_PLAYERS);
+        }
+    }
+
+    void updateConfirmed()
+    {
+        uint32_t upTo = received[0];
+        for (int s = 1; s < match.players; ++s)
+            upTo = std::min(upTo, received[s]);
+        confirm(upTo);
+    }
+
+    // Snapshots the match and runs one tick on the known and predicted inputs.
+    void advance()
+    {
+        snapshots[match.tick % snapshots.size()].copyFrom(match);
+        run();
+    }
+
+    void run()
+    {
+        if ((int64_t)match.tick == corruptAt)
+            match.games[seat].receiveGarbage(1);
+        match.step(inputs[match.tick % INPUT_RING]);
+    }
+
+    // Restores the first mispredicted tick and runs forward again to where
+    // the match was.
+    void replay()
+    {
+        if (replayFrom < 0)
+            return;
+        const Clock::time_point start = Clock::now();
+        const uint32_t to = match.tick;
+        const int depth = (int)(to - (uint32_t)replayFrom);
+        match.copyFrom(snapshots[(uint32_t)replayFrom % snapshots.size()]);
+        replayFrom = -1;
+        // The corrected inputs may end the match sooner than predicted.
+        while (match.tick < to && !match.over())
+            advance();
+        ++rollbacks;
+        replayedTicks += (uint64_t)depth;
+        maxDepth = std::max(maxDepth, depth);
+        maxReplayNs = std::max<uint64_t>(maxReplayNs, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+};
+
+// One direction of an emulated slow path: data is held back for a latency
+// plus uniform jitter, but stays in order as it would on TCP, so a chunk
+// never overtakes the one before it and jitter shows up as bunching.
+class DelayLink
+{
+public:
+    DelayLink(int latencyUs, int jitterUs, uint64_t seed) : latencyUs(latencyUs), jitterUs(jitterUs), rng(seed) {}
+
+    void push(const char *data, size_t n, Clock::time_point now)
+    {
+        int64_t us = latencyUs;
+        if (jitterUs > 0)
+            us += (int64_t)(rng.next() % (uint64_t)(2 * jitterUs + 1)) - jitterUs;
+        last = std::max(last, now + std::chrono::microseconds(std::max<int64_t>(0, us)));
+        chunks.push_back(Chunk{last, std::string(data, n)});
+    }
+
+    bool empty() const { return chunks.empty(); }
+
+    Clock::time_point nextRelease() const { return chunks.front().at; }
+
+    // Writes out every chunk that is due. Returns false if the write failed.
+    bool flush(int fd, Clock::time_point now)
+    {
+        while (!chunks.empty() && chunks.front().at <= now)
+        {
+            const std::string &data = chunks.front().data;
+            size_t sent = 0;
+            while (sent < data.size())
+            {
+                const ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    return false;
+                sent += (size_t)n;
+            }
+            chunks.pop_front();
+        }
+        return true;
+    }
+
+private:
+    struct Chunk
+    {
+        Clock::time_point at;
+        std::string data;
+    };
+
+    int latencyUs;
+    int jitterUs;
+    Rng rng;
+    Clock::time_point last;
+    std::deque<Chunk> chunks;
+};
+
+// Both directions of one proxied connection: `down` faces the peer, `up`
+// the host. Used by --proxy and by the bench's --latency-ms.
+struct DelayRelay
+{
+    int down;
+    int up;
+    DelayLink toUp;
+    DelayLink toDown;
+    bool downOpen = true;
+    bool upOpen = true;
+
+    DelayRelay(int down, int up, int latencyUs, int jitterUs, uint64_t seed)
+        : down(down), up(up), toUp(latencyUs, jitterUs, seed), toDown(latencyUs, jitterUs, seed ^ 0x5DEECE66Dull)
+    {
+    }
+
+    // Queues what arrived on fd (down or up) for the other side. Returns
+    // false once fd is closed.
+    bool onReadable(int fd, Clock::time_point now)
+    {
+        char buffer[4096];
+        for (;;)
+        {
+            const ssize_t n = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+            {
+                (fd == down ? downOpen : upOpen) = false;
+                return false;
+            }
+            if (n < 0)
+                return true;
+            (fd == down ? toUp : toDown).push(buffer, (size_t)n, now);
+        }
+    }
+
+    // Writes what is due. Data for a side that has gone is dropped; data
+    // for the other still goes out at its time.
+    void flush(Clock::time_point now)
+    {
+        if (upOpen && !toUp.flush(up, now))
+            upOpen = false;
+        if (downOpen && !toDown.flush(down, now))
+            downOpen = false;
+    }
+
+    bool pending() const { return (upOpen && !toUp.empty()) || (downOpen && !toDown.empty()); }
+
+    // Once one side has gone and everything for the other is written, the
+    // relay has nothing left to do.
+    bool finished() const { return (!upOpen || !downOpen) && !pending(); }
+
+    // The next time flush() has something to write; only valid if pending().
+    Clock::time_point nextRelease() const
+    {
+        if (!upOpen || toUp.empty())
+            return toDown.nextRelease();
+        if (!downOpen || toDown.empty())
+            return toUp.nextRelease();
+        return std::min(toUp.nextRelease(), toDown.nextRelease());
+    }
+};
+
+enum class InputMode
+{
+    Keys,
+    Bot,
+    Random,
+};
+
+static uint8_t inputBit(Input input)
+{
+    return (uint8_t)(1u << (int)input);
+}
+
+static uint8_t keyBit(char key)
+{
+    switch (key)
+    {
+    case 'a':
+        return inputBit(Input::Left);
+    case 'd':
+        return inputBit(Input::Right);
+    case 's':
+        return inputBit(Input::SoftDrop);
+    case 'w':
+        return inputBit(Input::RotateCW);
+    case 'e':
+        return inputBit(Input::RotateCCW);
+    case ' ':
+        return inputBit(Input::HardDrop);
+    }
+    return 0;
+}
+
+// Chooses a seat's input each tick from its own board as its peer sees it.
+struct InputSource
+{
+    InputMode mode;
+    Rng rng;
+    BotConfig config;
+    std::string keys;      // bot: keys still to press for the current piece
+    uint32_t planned = ~0u; // bot: the piece count the keys were planned at
+
+    InputSource(InputMode mode, uint64_t seed) : mode(mode), rng(seed) {}
+
+    uint8_t next(const GameState &g)
+    {
+        if (mode == InputMode::Random)
+            return rng.below(8) == 0 ? (uint8_t)(1u << rng.below(INPUT_BITS)) : 0;
+        if (keys.empty() && g.pieces != planned)
+            plan(g);
+        if (keys.empty())
+            return 0;
+        const char k = keys.front();
+        keys.erase(keys.begin());
+        return keyBit(k);
+    }
+
+    // The keys to the bot's placement, one a tick: rotate, shift and hard
+    // drop, or for a placement under an overhang, soft drop beside it and
+    // slide in. The keys land `delay` ticks after the piece appeared, by
+    // which time gravity may have moved it a row; extra soft drops at the
+    // bottom do nothing, so either path survives that.
+    void plan(const GameState &g)
+    {
+        planned = g.pieces;
+        if (g.over)
+            return;
+        GameState copy = g;
+        const uint8_t queue[2] = {(uint8_t)copy.current.piece, (uint8_t)copy.next};
+        const SearchResult move = chooseMove(copy.board, queue, 2, copy.bag.remainingMask(), config);
+        if (move.found)
+        {
+            static const char *ROTATIONS[4] = {"", "w", "ww", "e"};
+            for (const char *k = ROTATIONS[move.best.rot]; *k != '\0'; ++k)
+            {
+                copy.apply(*k == 'w' ? Input::RotateCW : Input::RotateCCW);
+                keys += *k;
+            }
+            const Placement &to = move.best;
+            const Placement at = copy.current;
+            int from = to.x;
+            if (!dropsTo(copy.board, at, to.x, to))
+            {
+                for (int d = 1; d < GRID_COLS && from == to.x; ++d)
+                {
+                    for (int x : {to.x - d, to.x + d})
+                    {
+                        if (from == to.x && dropsTo(copy.board, at, x, to) && slides(copy.board, to, x))
+                            from = x;
+                    }
+                }
+            }
+            shiftKeys(at.x, from);
+            if (from != to.x)
+            {
+                keys.append((size_t)(to.y - at.y), 's');
+                shiftKeys(from, to.x);
+            }
+        }
+        keys += ' ';
+    }
+
+    void shiftKeys(int from, int to)
+    {
+        keys.append((size_t)std::abs(to - from), to < from ? 'a' : 'd');
+    }
+
+    // Whether the piece at `at`, shifted to column x along its row, then
+    // dropped, comes to rest on to's row.
+    static bool dropsTo(const Board &board, const Placement &at, int x, const Placement &to)
+    {
+        for (int step = at.x; step != x; step += x < at.x ? -1 : 1)
+        {
+            if (board.collides(at.piece, at.rot, step + (x < at.x ? -1 : 1), at.y))
+                return false;
+        }
+        int y = at.y;
+        while (!board.collides(at.piece, at.rot, x, y + 1))
+            ++y;
+        return y == to.y && !board.collides(at.piece, at.rot, x, to.y);
+    }
+
+    // Whether the piece can slide along to's row from column x to to.x.
+    static bool slides(const Board &board, const Placement &to, int x)
+    {
+        for (; x != to.x; x += x < to.x ? 1 : -1)
+        {
+            if (board.collides(to.piece, to.rot, x + (x < to.x ? 1 : -1), to.y))
+                return false;
+        }
+        return true;
+    }
+};
+
+static int connectTo(const std::string &unixPath, const std::string &host, int port)
+{
+    if (!unixPath.empty())
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, unixPath.c_str(), sizeof(addr.sun_path) - 1);
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    inet_pton(AF_INET, host.c_str(), &addr.sin_addr);
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0)
+    {
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return fd;
+    }
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+static int listenOn(const std::string &unixPath, const std::string &host, int port)
+{
+    if (!unixPath.empty())
+    {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (unixPath.size() >= sizeof(addr.sun_path))
+        {
+            std::fprintf(stderr, "socket path too long: %s\n", unixPath.c_str());
+            return -1;
+        }
+        std::strcpy(addr.sun_path, unixPath.c_str());
+        unlink(unixPath.c_str());
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0)
+        {
+            std::fprintf(stderr, "cannot listen on %s: %s\n", unixPath.c_str(), std::strerror(errno));
+            return -1;
+        }
+        return fd;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+    {
+        std::fprintf(stderr, "bad address %s\n", host.c_str());
+        return -1;
+    }
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0)
+    {
+        std::fprintf(stderr, "cannot listen on %s:%d: %s\n", host.c_str(), port, std::strerror(errno));
+        return -1;
+    }
+    return fd;
+}
+
+static void printResult(const VersusMatch &match)
+{
+    const int w = match.winner();
+    if (w >= 0)
+        std::printf("player %d wins after %u ticks (%.1f s)\n", w + 1, match.tick, (double)match.tick / TICK_HZ);
+    else
+        std::printf("draw after %u ticks (%.1f s)\n", match.tick, (double)match.tick / TICK_HZ);
+    for (int p = 0; p < match.players; ++p)
+    {
+        const GameState &g = match.games[p];
+        std::printf("  player %d: %d lines, %d points, %u pieces%s\n", p + 1, g.lines, g.score, g.pieces,
+                    g.over ? ", topped out" : "");
+    }
+}
+
+static int serve(int players, int delay, int window, uint32_t tickLimit, uint64_t seed, const std::string &unixPath,
+                 const std::string &host, int port)
+{
+    const int listener = listenOn(unixPath, host, port);
+    if (listener < 0)
+        return 1;
+    std::printf("waiting for %d players on %s\n", players,
+                unixPath.empty() ? (host + ":" + std::to_string(port)).c_str() : unixPath.c_str());
+    std::fflush(stdout);
+    std::vector<int> fds;
+    while ((int)fds.size() < players)
+    {
+        const int fd = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            std::fprintf(stderr, "accept failed: %s\n", std::strerror(errno));
+            return 1;
+        }
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fds.push_back(fd);
+        std::printf("player %zu joined\n", fds.size());
+        std::fflush(stdout);
+    }
+    close(listener);
+    if (!unixPath.empty())
+        unlink(unixPath.c_str());
+
+    VersusHost referee(fds, seed, delay, window, tickLimit);
+    if (!referee.start())
+    {
+        std::fprintf(stderr, "a player left before the start\n");
+        return 1;
+    }
+    std::vector<pollfd> polls;
+    for (int fd : fds)
+        polls.push_back(pollfd{fd, POLLIN, 0});
+    while (!referee.finished())
+    {
+        if (poll(polls.data(), polls.size(), -1) < 0 && errno != EINTR)
+            break;
+        for (size_t s = 0; s < polls.size() && !referee.finished(); ++s)
+        {
+            if (polls[s].revents != 0)
+                referee.onReadable((int)s);
+        }
+    }
+
+    int status = 0;
+    if (referee.desyncTick >= 0)
+    {
+        std::printf("desync: player %d disagreed at tick %lld\n", referee.desyncSeat + 1,
+                    (long long)referee.desyncTick);
+        status = 1;
+    }
+    else if (referee.disconnected)
+    {
+        std::printf("a player left at tick %u\n", referee.state().tick);
+        status = 1;
+    }
+    else
+        printResult(referee.state());
+    std::printf("%llu hash checks\n", (unsigned long long)referee.hashChecks);
+    std::fflush(stdout);
+
+    // Peers running ahead on rollback may still be sending. Closing with
+    // their inputs unread would reset the connection, which can throw away
+    // the last inputs relayed to them, so hang up politely and wait (up to
+    // a second) for them to do the same.
+    for (pollfd &p : polls)
+        shutdown(p.fd, SHUT_WR);
+    const Clock::time_point deadline = Clock::now() + std::chrono::seconds(1);
+    for (size_t open = polls.size(); open > 0 && Clock::now() < deadline;)
+    {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+        if (poll(polls.data(), polls.size(), (int)left.count() + 1) <= 0)
+            break;
+        for (pollfd &p : polls)
+        {
+            if (p.fd < 0 || p.revents == 0)
+                continue;
+            char discard[4096];
+            const ssize_t n = recv(p.fd, discard, sizeof(discard), MSG_DONTWAIT);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR))
+            {
+                p.fd = -1;
+                --open;
+            }
+        }
+    }
+    for (int fd : fds)
+        close(fd);
+    return status;
+}
+
+// Puts the terminal into character mode for --join --input keys, and back.
+struct RawTerminal
+{
+    termios saved{};
+    bool active = false;
+
+    RawTerminal()
+    {
+        if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved) != 0)
+            return;
+        termios raw = saved;
+        raw.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        active = tcsetattr(STDIN_FILENO, TCSANOW, &raw) == 0;
+    }
+
+    ~RawTerminal()
+    {
+        if (active)
+            tcsetattr(STDIN_FILENO, TCSANOW, &saved);
+    }
+};
+
+static void writeAll(const std::string &out)
+{
+    size_t sent = 0;
+    while (sent < out.size())
+    {
+        const ssize_t n = write(STDOUT_FILENO, out.data() + sent, out.size() - sent);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return;
+        sent += (size_t)n;
+    }
+}
+
+// One line under the board with every player's progress.
+static std::string statusLine(const VersusMatch &match, int seat)
+{
+    std::string line;
+    for (int p = 0; p < match.players; ++p)
+    {
+        const GameState &g = match.games[p];
+        char part[64];
+        std::snprintf(part, sizeof(part), "%sP%d%s %d lines%s", p > 0 ? "   " : "", p + 1, p == seat ? " (you)" : "",
+                      g.lines, g.over ? " OUT" : g.pendingGarbage > 0 ? (" +" + std::to_string(g.pendingGarbage)).c_str() : "");
+        line += part;
+    }
+    return line;
+}
+
+static int join(const std::string &unixPath, const std::string &host, int port, InputMode mode, uint64_t seed)
+{
+    const int fd = connectTo(unixPath, host, port);
+    if (fd < 0)
+    {
+        std::fprintf(stderr, "cannot connect: %s\n", std::strerror(errno));
+        return 1;
+    }
+    std::printf("waiting for the other players\n");
+    std::fflush(stdout);
+    VersusPeer peer(fd);
+    if (!peer.handshake())
+    {
+        std::fprintf(stderr, "the host closed the connection\n");
+        return 1;
+    }
+
+    InputSource source(mode, seed ^ (uint64_t)peer.seat);
+    RawTerminal terminal;
+    AnsiRenderer renderer;
+    std::string shownStatus;
+    std::string out;
+    uint8_t pressed = 0;
+    bool quit = false;
+    const TickClock clock;
+    auto due = [&](uint32_t tick) { return clock.at(tick); };
+
+    // Inputs that arrived before the host closed still play out.
+    while (!quit && !peer.finished() && peer.desyncTick < 0 && (!peer.closed || peer.ready()))
+    {
+        peer.settle();
+        const Clock::time_point now = Clock::now();
+        bool stepped = peer.match.over(); // a rollback may have ended it
+        while (peer.ready() && due(peer.match.tick) <= now)
+        {
+            uint8_t input = pressed;
+            pressed = 0;
+            if (mode != InputMode::Keys)
+                input = source.next(peer.match.games[peer.seat]);
+            peer.step(input);
+            stepped = true;
+        }
+        if (stepped)
+        {
+            out.clear();
+            renderer.render(peer.match.games[peer.seat], out);
+            const std::string status = statusLine(peer.match, peer.seat);
+            if (status != shownStatus)
+            {
+                out += "\x1b[0m\x1b[";
+                out += std::to_string(AnsiRenderer::HEIGHT + 1);
+                out += ";1H\x1b[K";
+                out += status;
+                shownStatus = status;
+            }
+            writeAll(out);
+        }
+
+        if (peer.finished() || (peer.closed && !peer.ready()))
+            break;
+        pollfd polls[2] = {{peer.closed ? -1 : fd, POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+        int timeout = -1;
+        if (peer.ready())
+            timeout = (int)std::max<int64_t>(
+                0, std::chrono::duration_cast<std::chrono::milliseconds>(due(peer.match.tick) - Clock::now()).count() + 1);
+        if (poll(polls, terminal.active ? 2 : 1, timeout) < 0 && errno != EINTR)
+            break;
+        if (polls[0].revents != 0)
+            peer.onReadable();
+        if (terminal.active && polls[1].revents != 0)
+        {
+            char keys[64];
+            const ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+            for (ssize_t i = 0; i < n; ++i)
+            {
+                if (keys[i] == 'q')
+                    quit = true;
+                pressed |= keyBit(keys[i]);
+            }
+        }
+    }
+
+    out.clear();
+    AnsiRenderer::finish(out);
+    writeAll(out);
+    close(fd);
+    if (peer.desyncTick >= 0)
+    {
+        std::printf("\ndesync at tick %lld, match abandoned\n", (long long)peer.desyncTick);
+        return 1;
+    }
+    std::printf("\n");
+    if (!peer.match.over())
+    {
+        std::printf("%s at tick %u\n", quit ? "left the match" : "the host closed the match", peer.match.tick);
+        return quit ? 0 : 1;
+    }
+    const int w = peer.match.winner();
+    std::printf("%s\n", w == peer.seat ? "you win" : w >= 0 ? "you lose" : "draw");
+    printResult(peer.match);
+    return 0;
+}
+
+struct BenchOptions
+{
+    int matches = 16;
+    int players = 2;
+    int delay = 2;
+    int window = 0;
+    uint32_t ticks = 1200;
+    int hz = TICK_HZ; // 0 = unpaced
+    int threads = 1;
+    InputMode mode = InputMode::Bot;
+    uint64_t seed = 1;
+    int64_t desyncAt = -1;
+    int latencyUs = 0; // each way, between host and peer
+    int jitterUs = 0;
+};
+
+struct BenchStats
+{
+    uint64_t ticks = 0;  // match ticks, counted once per match
+    uint64_t stalls = 0; // peer ticks that were due but had to wait for inputs
+    uint64_t peerTicks = 0;
+    uint64_t bytes = 0;
+    uint64_t hashChecks = 0;
+    uint64_t desyncs = 0;
+    uint64_t wins = 0;
+    uint64_t disconnects = 0;
+    uint64_t rollbacks = 0;
+    uint64_t replayedTicks = 0;
+    int maxDepth = 0;
+    uint64_t maxReplayNs = 0;
+};
+
+// What an epoll event or timer in the bench refers to.
+struct BenchEndpoint
+{
+    VersusHost *host = nullptr;
+    int seat = 0;
+    struct BenchPeer *peer = nullptr;
+    struct BenchRelay *relay = nullptr;
+    int fd = -1; // relay: the side this endpoint reads
+};
+
+struct BenchPeer
+{
+    std::unique_ptr<VersusPeer> versus;
+    InputSource source;
+    TimerNode timer;
+    int64_t stalledAt = -1; // last tick counted as a stall
+    int64_t phaseUs = 0;    // when the match's ticks fall within a tick period
+    bool done = false;
+    BenchEndpoint endpoint;
+
+    BenchPeer(int fd, InputMode mode, uint64_t seed) : versus(new VersusPeer(fd)), source(mode, seed) {}
+};
+
+// A DelayRelay between one seat and its host.
+struct BenchRelay
+{
+    DelayRelay relay;
+    TimerNode timer;
+    BenchEndpoint downEnd;
+    BenchEndpoint upEnd;
+
+    BenchRelay(int down, int up, const BenchOptions &o, uint64_t seed) : relay(down, up, o.latencyUs, o.jitterUs, seed)
+    {
+        downEnd.relay = upEnd.relay = this;
+        downEnd.fd = down;
+        upEnd.fd = up;
+        timer.owner = &downEnd;
+    }
+};
+
+// Plays matches [begin, end) to the end on one thread.
+static void runBench(const BenchOptions &o, int begin, int end, LatencyHistogram &latency, BenchStats &stats)
+{
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    std::vector<std::unique_ptr<VersusHost>> hosts;
+    std::vector<std::unique_ptr<BenchEndpoint>> hostEndpoints;
+    std::vector<std::unique_ptr<BenchPeer>> peers;
+    std::vector<std::unique_ptr<BenchRelay>> relays;
+    std::vector<int> sockets;
+    Rng seeds(o.seed + (uint64_t)begin);
+    const bool delayed = o.latencyUs > 0 || o.jitterUs > 0;
+    auto watch = [&](int fd, BenchEndpoint *e)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = e;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    };
+    auto pair = [&](int fds[2])
+    {
+        socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds);
+        sockets.push_back(fds[0]);
+        sockets.push_back(fds[1]);
+    };
+
+    for (int m = begin; m < end; ++m)
+    {
+        std::vector<int> hostFds;
+        const size_t first = peers.size();
+        for (int p = 0; p < o.players; ++p)
+        {
+            int toHost[2];
+            pair(toHost);
+            hostFds.push_back(toHost[0]);
+            int peerFd = toHost[1];
+            if (delayed)
+            {
+                int toPeer[2];
+                pair(toPeer);
+                relays.emplace_back(new BenchRelay(toPeer[0], toHost[1], o, seeds.next()));
+                watch(toPeer[0], &relays.back()->downEnd);
+                watch(toHost[1], &relays.back()->upEnd);
+                peerFd = toPeer[1];
+            }
+            peers.emplace_back(new BenchPeer(peerFd, o.mode, seeds.next()));
+        }
+        // Spread the matches over a tick period so they don't all tick at once.
+        const int64_t phaseUs = o.hz > 0 ? (int64_t)(seeds.next() % (uint64_t)(1000000 / o.hz)) : 0;
+        for (int p = 0; p < o.players; ++p)
+            peers[first + p]->phaseUs = phaseUs;
+        hosts.emplace_back(new VersusHost(hostFds, o.seed + (uint64_t)m, o.delay, o.window, o.ticks));
+        hosts.back()->start();
+        for (int p = 0; p < o.players; ++p)
+        {
+            hostEndpoints.emplace_back(new BenchEndpoint{hosts.back().get(), p, nullptr, nullptr, -1});
+            watch(hostFds[p], hostEndpoints.back().get());
+        }
+    }
+
+    const Clock::time_point start = Clock::now();
+    TimerWheel wheel(0);
+    auto tickAt = [&](Clock::time_point t)
+    {
+        return t <= start ? 0 : (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(t - start).count();
+    };
+    auto wakeAt = [&](TimerNode &timer, Clock::time_point t)
+    {
+        const auto offset = std::chrono::duration_cast<std::chrono::microseconds>(t - start);
+        wheel.schedule(timer, (uint64_t)(offset.count() + 999) / 1000);
+    };
+
+    // Passes on what a relay holds that is due, then sleeps until the rest is.
+    auto flush = [&](BenchRelay &r, Clock::time_point now)
+    {
+        r.relay.flush(now);
+        if (r.relay.pending())
+            wakeAt(r.timer, r.relay.nextRelease());
+    };
+
+    // The START has to cross the relay before the handshake can read it.
+    for (auto &r : relays)
+    {
+        r->relay.onReadable(r->relay.up, start);
+        r->relay.flush(r->relay.toDown.nextRelease());
+    }
+    for (auto &peer : peers)
+    {
+        BenchPeer &p = *peer;
+        p.versus->handshake();
+        p.versus->latency = &latency;
+        if (o.desyncAt >= 0 && p.versus->seat == 0)
+            p.versus->corruptAt = o.desyncAt;
+        p.timer.owner = &p.endpoint;
+        p.endpoint.peer = &p;
+        watch(p.versus->fd, &p.endpoint);
+    }
+
+    auto due = [&](const BenchPeer &p)
+    {
+        const int64_t tick = p.versus->match.tick;
+        return start + std::chrono::microseconds(p.phaseUs + tick * 1000000 / std::max(o.hz, 1));
+    };
+    size_t running = peers.size();
+
+    // Runs every tick the peer may: its inputs are in (or, with rollback,
+    // it is inside the prediction window) and, when paced, its time has
+    // come. Then waits on the wheel or for the next input.
+    auto drive = [&](BenchPeer &p, Clock::time_point now)
+    {
+        VersusPeer &v = *p.versus;
+        v.settle();
+        while (!p.done)
+        {
+            if (v.finished() || (v.closed && !v.ready()) || v.desyncTick >= 0)
+            {
+                p.done = true;
+                --running;
+                wheel.cancel(p.timer);
+                break;
+            }
+            const bool isDue = o.hz == 0 || due(p) <= now;
+            if (!v.ready())
+            {
+                if (isDue && o.hz != 0 && p.stalledAt != (int64_t)v.match.tick)
+                {
+                    p.stalledAt = v.match.tick;
+                    ++stats.stalls;
+                }
+                break;
+            }
+            if (!isDue)
+            {
+                wakeAt(p.timer, due(p));
+                break;
+            }
+            const uint8_t input = p.source.next(v.match.games[v.seat]);
+            v.step(input);
+            ++stats.peerTicks;
+        }
+    };
+
+    for (auto &p : peers)
+        drive(*p, start);
+
+    epoll_event events[512];
+    while (running > 0)
+    {
+        const Clock::time_point now = Clock::now();
+        wheel.advance(tickAt(now), [&](TimerNode &t)
+        {
+            BenchEndpoint &e = *(BenchEndpoint *)t.owner;
+            if (e.peer != nullptr)
+                drive(*e.peer, now);
+            else
+                flush(*e.relay, now);
+        });
+        if (running == 0)
+            break;
+
+        int timeout = -1;
+        const uint64_t wake = wheel.nextWake();
+        if (wake != 0)
+            timeout = (int)std::max<int64_t>(0, (int64_t)wake - (int64_t)tickAt(now));
+        const int n = epoll_wait(epfd, events, 512, timeout);
+        const Clock::time_point arrived = Clock::now();
+        for (int i = 0; i < n; ++i)
+        {
+            BenchEndpoint &e = *(BenchEndpoint *)events[i].data.ptr;
+            if (e.host != nullptr)
+            {
+                if (!e.host->finished())
+                    e.host->onReadable(e.seat);
+                else
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, e.host->fdOf(e.seat), nullptr);
+                continue;
+            }
+            if (e.relay != nullptr)
+            {
+                if (!e.relay->relay.onReadable(e.fd, arrived))
+                    epoll_ctl(epfd, EPOLL_CTL_DEL, e.fd, nullptr);
+                flush(*e.relay, arrived);
+                continue;
+            }
+            BenchPeer &p = *e.peer;
+            if (!p.done)
+            {
+                p.versus->onReadable();
+                drive(p, arrived);
+            }
+            if (p.done)
+                epoll_ctl(epfd, EPOLL_CTL_DEL, p.versus->fd, nullptr);
+        }
+    }
+
+    for (auto &h : hosts)
+    {
+        stats.ticks += h->state().tick;
+        stats.hashChecks += h->hashChecks;
+        stats.desyncs += h->desyncTick >= 0 ? 1 : 0;
+        stats.wins += h->state().winner() >= 0 ? 1 : 0;
+        stats.disconnects += h->disconnected ? 1 : 0;
+    }
+    for (auto &p : peers)
+    {
+        const VersusPeer &v = *p->versus;
+        stats.bytes += v.bytes;
+        stats.rollbacks += v.rollbacks;
+        stats.replayedTicks += v.replayedTicks;
+        stats.maxDepth = std::max(stats.maxDepth, v.maxDepth);
+        stats.maxReplayNs = std::max(stats.maxReplayNs, v.maxReplayNs);
+    }
+    for (int fd : sockets)
+        close(fd);
+    close(epfd);
+}
+
+static double cpuSeconds()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static int bench(BenchOptions o)
+{
+    o.threads = std::max(1, std::min(o.threads, o.matches));
+    std::printf("%d matches x %d players, delay %d ticks, %s, %s, %s input, %d threads\n", o.matches, o.players,
+                o.delay, o.window > 0 ? ("rollback " + std::to_string(o.window) + " ticks").c_str() : "lockstep",
+                o.hz > 0 ? (std::to_string(o.hz) + " Hz").c_str() : "unpaced",
+                o.mode == InputMode::Bot ? "bot" : "random", o.threads);
+    if (o.latencyUs > 0 || o.jitterUs > 0)
+        std::printf("links delayed %.1f ms +- %.1f ms each way\n", o.latencyUs / 1000.0, o.jitterUs / 1000.0);
+
+    LatencyHistogram latency;
+    std::vector<BenchStats> stats(o.threads);
+    std::vector<std::thread> workers;
+    const double cpuStart = cpuSeconds();
+    const Clock::time_point start = Clock::now();
+    for (int t = 0; t < o.threads; ++t)
+    {
+        const int begin = o.matches * t / o.threads;
+        const int end = o.matches * (t + 1) / o.threads;
+        workers.emplace_back([&, t, begin, end]() { runBench(o, begin, end, latency, stats[t]); });
+    }
+    for (auto &w : workers)
+        w.join();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const double cpu = cpuSeconds() - cpuStart;
+
+    BenchStats total;
+    for (const BenchStats &s : stats)
+    {
+        total.ticks += s.ticks;
+        total.stalls += s.stalls;
+        total.peerTicks += s.peerTicks;
+        total.bytes += s.bytes;
+        total.hashChecks += s.hashChecks;
+        total.desyncs += s.desyncs;
+        total.wins += s.wins;
+        total.disconnects += s.disconnects;
+        total.rollbacks += s.rollbacks;
+        total.replayedTicks += s.replayedTicks;
+        total.maxDepth = std::max(total.maxDepth, s.maxDepth);
+        total.maxReplayNs = std::max(total.maxReplayNs, s.maxReplayNs);
+    }
+    std::printf("%llu match ticks in %.2f s: %.0f ticks/s, %.0f player ticks/s, %.2f us CPU per player tick\n",
+                (unsigned long long)total.ticks, seconds, total.ticks / seconds, total.peerTicks / seconds,
+                total.peerTicks ? cpu * 1e6 / total.peerTicks : 0.0);
+    std::printf("input to confirmed tick over %llu inputs: p50 %.3f ms, p99 %.3f ms, p99.9 %.3f ms, max %.3f ms\n",
+                (unsigned long long)latency.count(), latency.percentile(0.5) / 1000.0,
+                latency.percentile(0.99) / 1000.0, latency.percentile(0.999) / 1000.0, latency.percentile(1) / 1000.0);
+    if (o.hz > 0)
+        std::printf("stalled on %.3f%% of ticks, %.0f bytes/s per player\n",
+                    total.peerTicks ? 100.0 * total.stalls / total.peerTicks : 0.0,
+                    total.bytes / seconds / (o.matches * o.players));
+    if (o.window > 0)
+        std::printf("%llu rollbacks (%.2f per 100 player ticks), mean depth %.1f, max depth %d ticks, longest %.1f us\n",
+                    (unsigned long long)total.rollbacks,
+                    total.peerTicks ? 100.0 * total.rollbacks / total.peerTicks : 0.0,
+                    total.rollbacks ? (double)total.replayedTicks / total.rollbacks : 0.0, total.maxDepth,
+                    total.maxReplayNs / 1000.0);
+    std::printf("%llu matches won outright, %llu hash checks, %llu desyncs, %llu disconnects\n",
+                (unsigned long long)total.wins, (unsigned long long)total.hashChecks,
+                (unsigned long long)total.desyncs, (unsigned long long)total.disconnects);
+    if (o.desyncAt >= 0)
+        return total.desyncs == (uint64_t)o.matches ? 0 : 1;
+    return total.desyncs == 0 && total.disconnects == 0 ? 0 : 1;
+}
+
+// Forwards every connection on the listen address to the host, delaying
+// each direction by latency +- jitter: a stand-in for a real network when
+// trying rollback (or lockstep) by hand.
+static int proxy(const std::string &listenUnix, int listenPort, const std::string &unixPath, const std::string &host,
+                 int port, int latencyUs, int jitterUs)
+{
+    const int listener = listenOn(listenUnix, "127.0.0.1", listenPort);
+    if (listener < 0)
+        return 1;
+    std::printf("delaying %.1f ms +- %.1f ms each way from %s to %s\n", latencyUs / 1000.0, jitterUs / 1000.0,
+                listenUnix.empty() ? ("127.0.0.1:" + std::to_string(listenPort)).c_str() : listenUnix.c_str(),
+                unixPath.empty() ? (host + ":" + std::to_string(port)).c_str() : unixPath.c_str());
+    std::fflush(stdout);
+
+    Rng seeds((uint64_t)Clock::now().time_since_epoch().count());
+    std::vector<std::unique_ptr<DelayRelay>> relays;
+    std::vector<pollfd> polls;
+    for (;;)
+    {
+        Clock::time_point now = Clock::now();
+        int timeout = -1;
+        polls.assign(1, pollfd{listener, POLLIN, 0});
+        for (const auto &r : relays)
+        {
+            polls.push_back(pollfd{r->downOpen ? r->down : -1, POLLIN, 0});
+            polls.push_back(pollfd{r->upOpen ? r->up : -1, POLLIN, 0});
+            if (r->pending())
+            {
+                const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(r->nextRelease() - now);
+                timeout = (int)std::max<int64_t>(0, std::min<int64_t>(timeout < 0 ? INT32_MAX : timeout, wait.count() + 1));
+            }
+        }
+        if (poll(polls.data(), polls.size(), timeout) < 0 && errno != EINTR)
+            return 1;
+        now = Clock::now();
+
+        for (size_t i = 0; i < relays.size(); ++i)
+        {
+            DelayRelay &r = *relays[i];
+            if (polls[1 + 2 * i].revents != 0)
+                r.onReadable(r.down, now);
+            if (polls[2 + 2 * i].revents != 0)
+                r.onReadable(r.up, now);
+        }
+        // A relay that has passed on everything after one side closed
+        // closes the other.
+        size_t kept = 0;
+        for (auto &r : relays)
+        {
+            r->flush(now);
+            if (!r->finished())
+            {
+                relays[kept++] = std::move(r);
+                continue;
+            }
+            close(r->down);
+            close(r->up);
+        }
+        relays.resize(kept);
+
+        if (polls[0].revents != 0)
+        {
+            const int down = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (down < 0)
+                continue;
+            const int up = connectTo(unixPath, host, port);
+            if (up < 0)
+            {
+                std::fprintf(stderr, "cannot reach the host: %s\n", std::strerror(errno));
+                close(down);
+                continue;
+            }
+            const int one = 1;
+            setsockopt(down, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            relays.emplace_back(new DelayRelay(down, up, latencyUs, jitterUs, seeds.next()));
+        }
+    }
+}
+
+// How deep a rollback fits in a millisecond: plays a bot match while
+// snapshotting every tick as a rollback peer does, and every 8 ticks
+// restores the snapshot MAX_ROLLBACK ticks back and runs all of them again.
+// Bounds how large --rollback can be before one frame's replay misses its
+// deadline.
+static int rollbackSpeed(uint64_t seed)
+{
+    const uint32_t ticks = 60 * TICK_HZ;
+    const double frameUs = 1e6 / TICK_HZ;
+    for (int players : {2, 4, 8})
+    {
+        // Record a match first so the bots' thinking is not timed.
+        std::vector<std::array<uint8_t, MAX_PLAYERS>> inputs;
+        {
+            VersusMatch match(players, seed, ticks);
+            std::vector<InputSource> sources;
+            for (int p = 0; p < players; ++p)
+                sources.emplace_back(InputMode::Bot, seed + (uint64_t)p);
+            while (!match.over())
+            {
+                std::array<uint8_t, MAX_PLAYERS> in{};
+                for (int p = 0; p < players; ++p)
+                    in[p] = sources[p].next(match.games[p]);
+                match.step(in.data());
+                inputs.push_back(in);
+            }
+        }
+
+        const size_t window = MAX_ROLLBACK;
+        std::vector<VersusMatch> snapshots(window * 2);
+        VersusMatch match(players, seed, ticks);
+        LatencyHistogram replays; // nanoseconds per full-window rollback
+        const Clock::time_point start = Clock::now();
+        for (uint32_t t = 0; t < inputs.size(); ++t)
+        {
+            snapshots[t % snapshots.size()].copyFrom(match);
+            match.step(inputs[t].data());
+            if (t + 1 < window || (t + 1) % 8 != 0)
+                continue;
+            const Clock::time_point begin = Clock::now();
+            const uint32_t to = match.tick;
+            match.copyFrom(snapshots[(to - window) % snapshots.size()]);
+            while (match.tick < to)
+            {
+                snapshots[match.tick % snapshots.size()].copyFrom(match);
+                match.step(inputs[match.tick].data());
+            }
+            replays.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin).count());
+        }
+        const double totalNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        const double simulated = (double)inputs.size() + (double)replays.count() * window;
+        const double p99TickNs = (double)replays.percentile(0.99) / window;
+        std::printf("%d players, %zu ticks: %.2f us per snapshot and tick; %zu-tick rollback p50 %.1f us, p99 %.1f us, "
+                    "max %.1f us\n",
+                    players, inputs.size(), totalNs / simulated / 1000.0, window, replays.percentile(0.5) / 1000.0,
+                    replays.percentile(0.99) / 1000.0, replays.percentile(1) / 1000.0);
+        std::printf("  %.0f ticks of rollback per ms at p99; the slowest %zu-tick rollback took %.1f%% of a %.1f ms frame\n",
+                    p99TickNs > 0 ? 1e6 / p99TickNs : 0.0, window, 100.0 * replays.percentile(1) / 1000.0 / frameUs,
+                    frameUs / 1000.0);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    enum class Role
+    {
+        None,
+        Serve,
+        Join,
+        Bench,
+        Proxy,
+        RollbackSpeed,
+    } role = Role::None;
+    std::string host = "127.0.0.1";
+    int port = 7100;
+    std::string unixPath;
+    int players = 2;
+    InputMode mode = InputMode::Keys;
+    bool modeGiven = false;
+    BenchOptions bo;
+    bo.threads = (int)std::max(1u, std::thread::hardware_concurrency());
+    uint32_t ticks = 0;
+    bool ticksGiven = false;
+    std::string listenUnix;
+    int listenPort = 7101;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "--serve"))
+            role = Role::Serve;
+        else if (!std::strcmp(arg, "--join"))
+            role = Role::Join;
+        else if (!std::strcmp(arg, "--bench"))
+            role = Role::Bench;
+        else if (!std::strcmp(arg, "--proxy"))
+            role = Role::Proxy;
+        else if (!std::strcmp(arg, "--rollback-speed"))
+            role = Role::RollbackSpeed;
+        else if (!std::strcmp(arg, "--listen-port") && hasValue)
+            listenPort = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--listen-unix") && hasValue)
+            listenUnix = argv[++i];
+        else if (!std::strcmp(arg, "--rollback") && hasValue)
+            bo.window = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--latency-ms") && hasValue)
+            bo.latencyUs = (int)(std::atof(argv[++i]) * 1000);
+        else if (!std::strcmp(arg, "--jitter-ms") && hasValue)
+            bo.jitterUs = (int)(std::atof(argv[++i]) * 1000);
+        else if (!std::strcmp(arg, "--host") && hasValue)
+            host = argv[++i];
+        else if (!std::strcmp(arg, "--port") && hasValue)
+            port = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--unix") && hasValue)
+            unixPath = argv[++i];
+        else if (!std::strcmp(arg, "--players") && hasValue)
+            players = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--delay") && hasValue)
+            bo.delay = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--ticks") && hasValue)
+        {
+            ticks = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+            ticksGiven = true;
+        }
+        else if (!std::strcmp(arg, "--seed") && hasValue)
+            bo.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (!std::strcmp(arg, "--matches") && hasValue)
+            bo.matches = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--hz") && hasValue)
+            bo.hz = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--threads") && hasValue)
+            bo.threads = std::atoi(argv[++i]);
+        else if (!std::strcmp(arg, "--desync-at") && hasValue)
+            bo.desyncAt = std::atoll(argv[++i]);
+        else if (!std::strcmp(arg, "--input") && hasValue)
+        {
+            const std::string input = argv[++i];
+            modeGiven = true;
+            if (input == "keys")
+                mode = InputMode::Keys;
+            else if (input == "bot")
+                mode = InputMode::Bot;
+            else if (input == "random")
+                mode = InputMode::Random;
+            else
+            {
+                usage();
+                return 2;
+            }
+        }
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+    // In lockstep a peer sends its input for a tick only after the tick
+    // before has been confirmed, so with no delay it would wait on itself.
+    if (role == Role::None || players < 1 || players > MAX_PLAYERS || bo.delay < (bo.window > 0 ? 0 : 1) ||
+        bo.delay > MAX_DELAY || bo.window < 0 || bo.window > MAX_ROLLBACK || bo.latencyUs < 0 || bo.jitterUs < 0 ||
+        (role == Role::Bench && ((mode == InputMode::Keys && modeGiven) || (ticksGiven && ticks == 0))))
+    {
+        usage();
+        return 2;
+    }
+
+    switch (role)
+    {
+    case Role::Serve:
+        return serve(players, bo.delay, bo.window, ticks, bo.seed, unixPath, host, port);
+    case Role::Join:
+        return join(unixPath, host, port, mode, bo.seed ^ (uint64_t)Clock::now().time_since_epoch().count());
+    case Role::Bench:
+        bo.players = players;
+        bo.matches = std::max(1, bo.matches);
+        if (ticksGiven)
+            bo.ticks = ticks;
+        if (modeGiven)
+            bo.mode = mode;
+        return bench(bo);
+    case Role::Proxy:
+        return proxy(listenUnix, listenPort, unixPath, host, port, bo.latencyUs, bo.jitterUs);
+    case Role::RollbackSpeed:
+        return rollbackSpeed(bo.seed);
+    case Role::None:
+        break;
+    }
+    return 2;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "tetrois_engine.hpp"
+#include "tetrois_game.hpp"
+
+// Deterministic versus rules for up to MAX_PLAYERS boards, and the wire
+// format tetrois-versus plays them over. Every peer runs the whole match
+// from the same seed and the same per-tick inputs, so the inputs are all
+// that travel; a hash of the match each tick catches any divergence.
+
+constexpr int MAX_PLAYERS = 8;
+
+// Bit i of a player's input for a tick means Input(i) was pressed; several
+// keys in one tick are applied in Input order.
+constexpr int INPUT_BITS = 6;
+
+struct VersusMatch
+{
+    int players = 0;
+    uint64_t seed = 0;
+    uint32_t tick = 0;
+    uint32_t tickLimit = 0; // the match is drawn at this tick, 0 = never
+    GameState games[MAX_PLAYERS];
+    uint8_t targets[MAX_PLAYERS] = {}; // seat each player's last attack went to
+
+    VersusMatch() = default;
+
+    // Every board gets the same piece sequence; garbage holes differ.
+    VersusMatch(int players, uint64_t seed, uint32_t tickLimit = 0) : players(players), seed(seed), tickLimit(tickLimit)
+    {
+        for (int p = 0; p < players; ++p)
+        {
+            games[p] = GameState(seed);
+            games[p].holes = Rng(seed ^ (0x6A7BA6Eull * (uint64_t)(p + 1)));
+            targets[p] = (uint8_t)p;
+        }
+    }
+
+    int alive() const
+    {
+        int n = 0;
+        for (int p = 0; p < players; ++p)
+            n += games[p].over ? 0 : 1;
+        return n;
+    }
+
+    // Solo play ends when the board tops out, versus when one board is left.
+    bool over() const
+    {
+        return alive() <= (players > 1 ? 1 : 0) || (tickLimit != 0 && tick >= tickLimit);
+    }
+
+    // The last board standing, or -1 for a draw or a match still running.
+    int winner() const
+    {
+        if (players < 2 || alive() != 1)
+            return -1;
+        for (int p = 0; p < players; ++p)
+        {
+            if (!games[p].over)
+                return p;
+        }
+        return -1;
+    }
+
+    // Runs one tick: every board applies its inputs and gravity, then the
+    // garbage sent this tick is delivered in seat order.
+    void step(const uint8_t *inputs)
+    {
+        for (int p = 0; p < players; ++p)
+        {
+            GameState &g = games[p];
+            for (int bit = 0; bit < INPUT_BITS; ++bit)
+            {
+                if (inputs[p] & (1u << bit))
+                    g.apply((Input)bit);
+            }
+            g.advance(1);
+        }
+        for (int p = 0; p < players; ++p)
+        {
+            GameState &g = games[p];
+            if (g.outgoingGarbage == 0)
+                continue;
+            // Attacks rotate over the boards still alive.
+            for (int i = 1; i < players; ++i)
+            {
+                const int t = (targets[p] + i) % players;
+                if (t != p && !games[t].over)
+                {
+                    games[t].receiveGarbage(g.outgoingGarbage);
+                    targets[p] = (uint8_t)t;
+                    break;
+                }
+            }
+            g.outgoingGarbage = 0;
+        }
+        ++tick;
+    }
+
+    // Copies only the boards in play, so a snapshot of a two-player match
+    // costs a quarter of copying the whole struct.
+    void copyFrom(const VersusMatch &o)
+    {
+        players = o.players;
+        seed = o.seed;
+        tick = o.tick;
+        tickLimit = o.tickLimit;
+        std::copy(o.games, o.games + o.players, games);
+        std::copy(o.targets, o.targets + o.players, targets);
+    }
+
+    uint64_t hash() const
+    {
+        uint64_t h = tick;
+        for (int p = 0; p < players; ++p)
+            h = (h ^ games[p].hash()) * 0x9E3779B97F4A7C15ull + targets[p];
+        return h;
+    }
+};
+
+// One message; the same fixed layout in both directions, so a read never
+// has to reassemble variable-length records. Both ends are the same build
+// on the same machine, so it is sent as raw bytes.
+struct VersusMessage
+{
+    enum Type : uint8_t
+    {
+        // host -> peer: seat, players, delay, value = seed, tick = tick limit,
+        // aux = rollback window (0 = lockstep)
+        START = 'S',
+        // peer -> host: inputs[0] for `tick`, value = match hash at tick aux.
+        // Rollback only, host -> peer: the same, relayed from `seat`.
+        INPUT = 'I',
+        // Lockstep only, host -> peer: every seat's input for `tick`
+        FRAME = 'F',
+        // host -> peer: hashes disagreed at `tick`; the match is abandoned
+        DESYNC = 'D',
+    };
+
+    uint8_t type;
+    uint8_t seat;
+    uint8_t players;
+    uint8_t delay;
+    uint32_t tick;
+    uint64_t value;
+    uint32_t aux;
+    uint8_t inputs[MAX_PLAYERS];
+    uint8_t unused[4];
+};
+static_assert(sizeof(VersusMessage) == 32, "VersusMessage is sent as raw bytes");